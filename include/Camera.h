@@ -7,9 +7,38 @@
 #include <ospray/ospray.h>
 
 #include <string>
+#include <vector>
 
 namespace pbnj {
 
+    // everything needed to place a camera for one frame
+    struct CameraState {
+        float position[3];
+        float view[3];
+        float up[3];
+    };
+
+    // generated camera paths, all looking at the volume center
+    //  - ORBIT: circle around the up vector through the current position
+    //  - GREAT_CIRCLE: circle over the top and bottom of the volume,
+    //    through the current position
+    // spline flythroughs are made from keyframes instead, see setPath
+    enum PATHTYPE {ORBIT, GREAT_CIRCLE};
+
+    // projections a Camera can use
+    //  - PERSPECTIVE: pinhole camera looking along the view direction
+    //  - PANORAMIC: 360 by 180 degree equirectangular image of everything
+    //    around the camera position, the view direction is the middle of
+    //    the image
+    //  - ORTHOGRAPHIC: parallel rays along the view direction, the image
+    //    covers setOrthographicHeight world units vertically
+    //  - INWARD_SPHERICAL: the same 360 by 180 degree image as PANORAMIC,
+    //    but each ray starts on a sphere of setSphereRadius around the
+    //    camera position and goes in through its centre, so one render
+    //    shows the volume from every side; the middle of the image looks
+    //    along the view direction
+    enum CAMERATYPE {PERSPECTIVE, PANORAMIC, ORTHOGRAPHIC, INWARD_SPHERICAL};
+
     class Camera {
         public:
             Camera(int width, int height);
@@ -26,19 +55,61 @@ namespace pbnj {
             void centerView();
 
             void setRegion(float top, float right, float bottom, float left);
+            void getRegion(float &top, float &right, float &bottom,
+                    float &left);
+
+            // replaces the underlying OSPRay camera if the type changes
+            void setProjection(CAMERATYPE type);
+            CAMERATYPE getProjection();
+            // vertical field of view of perspective cameras, 60 by default
+            void setFieldOfView(float degrees);
+            // world space height of the image for orthographic cameras
+            void setOrthographicHeight(float height);
+            // radius of the sphere INWARD_SPHERICAL rays start from, it
+            // should enclose the volume
+            void setSphereRadius(float radius);
+
+            // place the camera so the whole volume just fills the image
+            // when looking along the current view direction (or toward
+            // the volume center if no view is set); margin > 1 leaves
+            // space around the volume
+            // an INWARD_SPHERICAL camera is moved to the volume center
+            // with a sphere just enclosing the volume instead
+            void frameVolume(Volume *v, float margin = 1.0);
+
+            // setters only record changes; this pushes all of them to OSPRay
+            // with a single commit, and does nothing if nothing changed
+            // the Renderer calls it before every frame
+            void commit();
 
             OSPCamera asOSPRayObject();
+            // incremented by every setter
+            unsigned long int getVersion();
+            // hash of everything that changes the image, the same for two
+            // cameras set up the same way
+            unsigned long int getHash();
 
-            //some sort of setPath function that takes an enum type for the path
-            //and a ... for path parameters
+            CameraState getState();
+            void setState(const CameraState &state);
+
+            // generate a path of the given number of frames starting from
+            // the current state; the radius is the orbit radius if one was
+            // set, otherwise the current distance from the volume center
+            void setPath(PATHTYPE type, unsigned int frames);
+            // Catmull-Rom spline through the keyframes, with frames spread
+            // evenly over the segments between them
+            void setPath(std::vector<CameraState> &keyframes,
+                    unsigned int frames);
+            std::vector<CameraState> &getPath();
 
             float viewX;
             float viewY;
             float viewZ;
 
-            std::string ID;
+            unsigned long int ID;
 
         private:
+            unsigned long int version;
             float xPos;
             float yPos;
             float zPos;
@@ -48,10 +119,19 @@ namespace pbnj {
             float orbitRadius;
             int imageWidth;
             int imageHeight;
+            float regionStart[2];
+            float regionEnd[2];
+            bool dirty;
 
+            CAMERATYPE projection;
+            float fovy;
+            float orthoHeight;
+            float sphereRadius;
             OSPCamera oCamera;
 
-            void updateOSPRayPosition();
+            std::vector<CameraState> path;
+
+            void releaseOSPRayCamera();
     };
 }
 
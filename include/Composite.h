@@ -0,0 +1,28 @@
+#ifndef PBNJ_COMPOSITE_H
+#define PBNJ_COMPOSITE_H
+
+#include "Image.h"
+
+namespace pbnj {
+
+    /* composites an OSPRay RGBA image (rows bottom to top) over the RGBA
+     * background color and copies it into out (rows top to bottom, stride
+     * bytes apart, in the given pixel format)
+     * the input's lower left corner lands at pixel (x, y) of out, counted
+     * from the bottom like OSPRay does
+     * a NULL background copies the pixels as they are, only flipping and
+     * converting them to the output format
+     * blending is done in 8 bit fixed point with SSE2 or AVX2, whichever
+     * the CPU supports, and rows are split across threads
+     */
+    void compositeImage(const unsigned char *in, int inWidth, int inHeight,
+            unsigned char *out, unsigned int outStride, int outHeight,
+            int x, int y, const unsigned char *background,
+            PIXELFORMAT format = RGBA);
+
+    // composites count pixels of a single row, no flipping
+    void compositeRow(const unsigned char *in, unsigned char *out,
+            int count, const unsigned char *background);
+}
+
+#endif
@@ -2,6 +2,8 @@
 #define PBNJ_CONFIGURATION_H
 
 #include <ConfigReader.h>
+#include <PNGEncoder.h>
+#include <TransferFunction.h>
 #include "rapidjson/document.h"
 
 #include <string>
@@ -32,9 +34,17 @@ namespace pbnj {
 
             std::vector<float> colorMap;
             std::vector<float> opacityMap;
+            OPACITYMODE opacityMode;
             float opacityAttenuation;
+            float lowPercentile;
+            float highPercentile;
+            bool preIntegration;
+            float samplingRate;
 
             unsigned int samples;
+            unsigned int tileSize;
+            unsigned int posterBandHeight;
+            PNGSettings pngSettings;
 
             float cameraX;
             float cameraY;
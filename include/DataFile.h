@@ -2,8 +2,10 @@
 #define PBNJ_DATAFILE_H
 
 #include <string>
+#include <vector>
 
 #include <pbnj.h>
+#include <QuantileSketch.h>
 
 namespace pbnj {
 
@@ -19,11 +21,23 @@ namespace pbnj {
                     bool memmap=false);
             void calculateStatistics();
             void printStatistics();
+            // approximate, p in [0, 100]
+            float percentile(float p);
+
+            // counts of values in num_bins equal-width bins over [min, max]
+            std::vector<unsigned long int> histogram(unsigned int num_bins);
+            // same, over a given range; values outside it are not counted
+            std::vector<unsigned long int> histogram(unsigned int num_bins,
+                    float minimum, float maximum);
 
             // experimental
             void bin(unsigned int num_bins);
 
             std::string filename;
+            // the variable read from a NetCDF file, empty for binary files
+            std::string variable;
+            // seconds since the epoch, 0 if unknown
+            long int modifiedTime;
             FILETYPE filetype;
 
             unsigned long int xDim;
@@ -36,6 +50,8 @@ namespace pbnj {
             float avgVal; // eventually be 
             float stdDev; //
             float *data;  // template types
+            // filled by calculateStatistics, 32 KB
+            QuantileSketch valueSketch;
 
             bool statsCalculated;
 
@@ -0,0 +1,57 @@
+#ifndef PBNJ_IMAGE_H
+#define PBNJ_IMAGE_H
+
+#include <pbnj.h>
+
+#include <vector>
+
+namespace pbnj {
+
+    // pixel layouts images can be rendered into, 8 bits per channel
+    enum PIXELFORMAT {RGBA, RGB, BGRA};
+
+    unsigned int bytesPerPixel(PIXELFORMAT format);
+
+    /* a reusable pixel buffer for the Renderer to render into
+     * rows are stored top to bottom, stride bytes apart; resizing to a
+     * size that fits in the memory already held doesn't allocate, so a
+     * single Image can be rendered into every frame
+     */
+    class Image {
+        public:
+            // an empty RGBA image, sized by the first render into it
+            Image();
+            // a stride of 0 packs the rows tightly
+            Image(int width, int height, PIXELFORMAT format = RGBA,
+                    unsigned int stride = 0);
+
+            void resize(int width, int height);
+            void setFormat(PIXELFORMAT format);
+            // bytes from the start of one row to the next, 0 packs the
+            // rows tightly
+            void setStride(unsigned int stride);
+            // when false, the raw OSPRay pixels are copied without being
+            // composited onto the background color
+            void setComposite(bool composite);
+
+            unsigned char *getData();
+            int getWidth();
+            int getHeight();
+            unsigned int getStride();
+            PIXELFORMAT getFormat();
+            bool getComposite();
+
+        private:
+            std::vector<unsigned char> data;
+            int width;
+            int height;
+            PIXELFORMAT format;
+            unsigned int requestedStride;
+            unsigned int stride;
+            bool composite;
+
+            void layout();
+    };
+}
+
+#endif
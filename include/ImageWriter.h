@@ -0,0 +1,58 @@
+#ifndef PBNJ_IMAGEWRITER_H
+#define PBNJ_IMAGEWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pbnj {
+
+    /* writes encoded images to disk on a background thread
+     * at most maxQueued images wait to be written, write() blocks until
+     * there is room so a renderer that outpaces the disk slows down
+     * instead of holding every frame in memory
+     */
+    class ImageWriter {
+        public:
+            ImageWriter(unsigned int maxQueued = 4);
+            // writes everything still queued
+            ~ImageWriter();
+
+            // takes the contents of encoded, leaving it empty
+            void write(std::string filename,
+                    std::vector<unsigned char> &encoded);
+            // blocks until every queued image is written, returns false
+            // if any write failed since the last flush
+            bool flush();
+
+            unsigned int getQueued();
+            unsigned int getMaxQueued();
+
+            // writes a whole file on the calling thread through a large
+            // stdio buffer, returns false on any error
+            static bool writeFile(const std::string &filename,
+                    const std::vector<unsigned char> &data);
+
+        private:
+            typedef std::pair<std::string, std::vector<unsigned char> >
+                QueuedImage;
+            std::deque<QueuedImage> queue;
+            unsigned int maxQueued;
+            // an image is taken off the queue before it is written
+            bool writing;
+            bool stopping;
+            unsigned long int failures;
+
+            std::mutex lock;
+            std::condition_variable changed;
+            std::thread thread;
+
+            void run();
+    };
+}
+
+#endif
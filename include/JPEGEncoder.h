@@ -0,0 +1,66 @@
+#ifndef PBNJ_JPEGENCODER_H
+#define PBNJ_JPEGENCODER_H
+
+#include "Image.h"
+
+#include <vector>
+
+namespace pbnj {
+
+    // chroma resolution relative to luma, lower is smaller and faster
+    enum JPGSUBSAMPLING {SUBSAMPLE_444, SUBSAMPLE_422, SUBSAMPLE_420};
+
+    // DCT implementation, ISLOW is the most accurate, IFAST the fastest
+    enum JPGDCT {DCT_ISLOW, DCT_IFAST, DCT_FLOAT};
+
+    struct JPGSettings {
+        // in [1, 100]
+        int quality;
+        JPGSUBSAMPLING subsampling;
+        JPGDCT dct;
+        // compute optimal Huffman tables, a few percent smaller but
+        // another pass over the image
+        bool optimizeCoding;
+
+        JPGSettings();
+        // tuned for interactive latency rather than quality
+        static JPGSettings fast();
+    };
+
+    // libjpeg state, kept out of this header
+    struct JPEGCompressor;
+
+    /* encodes images with libjpeg, feeding it the interleaved rows
+     * directly; the compressor is set up once and reused for every image
+     * an encoder is only safe to use from one thread at a time
+     */
+    class JPEGEncoder {
+        public:
+            JPEGEncoder();
+            ~JPEGEncoder();
+
+            // pixels are rows top to bottom, stride bytes apart (0 packs
+            // them tightly); alpha is ignored
+            // returns false and leaves jpg empty if encoding failed
+            bool encode(std::vector<unsigned char> &jpg,
+                    const unsigned char *pixels, int width, int height,
+                    unsigned int stride, PIXELFORMAT format,
+                    const JPGSettings &settings);
+
+        private:
+            JPEGCompressor *compressor;
+            // rows converted to RGB when libjpeg can't take the format
+            std::vector<unsigned char> row;
+
+            JPEGEncoder(const JPEGEncoder &);
+            JPEGEncoder &operator=(const JPEGEncoder &);
+    };
+
+    // encodes with a JPEGEncoder kept by the calling thread
+    bool encodeJPG(std::vector<unsigned char> &jpg,
+            const unsigned char *pixels, int width, int height,
+            unsigned int stride, PIXELFORMAT format,
+            const JPGSettings &settings);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef PBNJ_PNGENCODER_H
+#define PBNJ_PNGENCODER_H
+
+#include "Image.h"
+
+#include <vector>
+
+namespace pbnj {
+
+    // how each row is filtered before compression
+    //  - FILTER_NONE: no filtering, fastest
+    //  - FILTER_UP: difference to the row above, cheap and good for
+    //    smooth renders
+    //  - FILTER_MINSUM: try every filter per row, keep the one with the
+    //    smallest sum (the PNG spec's heuristic)
+    //  - FILTER_ENTROPY: try every filter per row, keep the one with the
+    //    lowest entropy
+    enum PNGFILTER {FILTER_NONE, FILTER_UP, FILTER_MINSUM, FILTER_ENTROPY};
+
+    struct PNGSettings {
+        // zlib compression level, 1 (fastest) to 9 (smallest)
+        int level;
+        PNGFILTER filter;
+        // look one match ahead before committing to one, slower but
+        // smaller; zlib only does this at levels 4 and up, so turning it
+        // off caps the level at 3
+        bool lazyMatching;
+        // how far back matches are searched, a power of two in
+        // [512, 32768]
+        unsigned int windowSize;
+        // bands of rows compressed at the same time, 0 uses every
+        // hardware thread
+        unsigned int threads;
+        // let the encoder drop the alpha channel or use fewer bits when
+        // that is lossless, smaller files but the whole image is scanned
+        bool autoConvert;
+
+        PNGSettings();
+        // tuned for interactive latency rather than file size
+        static PNGSettings fast();
+        // smallest files this encoder can make
+        static PNGSettings best();
+    };
+
+    /* encodes an RGBA image (rows top to bottom, tightly packed) as a PNG
+     * filtered rows are split into bands that are deflated in parallel
+     * and joined into a single zlib stream, the same way pigz does
+     * returns 0 on success, or a lodepng error code
+     */
+    unsigned int encodePNG(std::vector<unsigned char> &png,
+            const unsigned char *rgba, int width, int height,
+            const PNGSettings &settings);
+
+    /* encodes a PNG a band of rows at a time, so an image far larger than
+     * memory can be written as it is rendered
+     * the rows are filtered and deflated in parallel like encodePNG does,
+     * keeping only the last row and the last 32K of filtered data between
+     * bands; autoConvert is not used, RGB rows make an RGB PNG
+     * each call replaces png with the bytes that follow what the previous
+     * call returned, so they can be written straight to a file
+     */
+    class PNGStreamEncoder {
+        public:
+            PNGStreamEncoder();
+
+            // starts an image with RGBA or RGB rows, png receives the
+            // signature and header
+            bool begin(std::vector<unsigned char> &png, int width,
+                    int height, PIXELFORMAT format,
+                    const PNGSettings &settings);
+            // the next rows of the image, top to bottom, stride bytes
+            // apart (0 packs them tightly)
+            bool encodeRows(std::vector<unsigned char> &png,
+                    const unsigned char *pixels, int rows,
+                    unsigned int stride);
+            // once every row was given, png receives the rest of the file
+            bool end(std::vector<unsigned char> &png);
+
+        private:
+            PNGSettings settings;
+            int width;
+            int height;
+            int rowsEncoded;
+            unsigned int channels;
+            // unfiltered, the filters of the next band's first row need it
+            std::vector<unsigned char> previousRow;
+            std::vector<unsigned char> filtered;
+            // the end of the filtered data so far, the deflate dictionary
+            // for the next band
+            std::vector<unsigned char> history;
+            std::vector<unsigned char> compressed;
+            unsigned long int checksum;
+            bool started;
+
+            void appendChunk(std::vector<unsigned char> &png,
+                    const char *type, const unsigned char *data,
+                    unsigned long int size);
+    };
+}
+
+#endif
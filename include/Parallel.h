@@ -0,0 +1,23 @@
+#ifndef PBNJ_PARALLEL_H
+#define PBNJ_PARALLEL_H
+
+#include <functional>
+
+namespace pbnj {
+
+    // number of threads parallelFor will split work across
+    unsigned int getNumThreads();
+
+    /* splits [0, count) into contiguous chunks, at most one per thread, and
+     * calls func(start, end, thread) on each chunk
+     * thread is always less than getNumThreads(), so callers can keep
+     * per-thread partial results in a vector of that size
+     * chunks smaller than minChunk are not worth a thread and get merged
+     */
+    void parallelFor(unsigned long int count,
+            std::function<void(unsigned long int, unsigned long int,
+                unsigned int)> func,
+            unsigned long int minChunk=1);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PBNJ_QOIENCODER_H
+#define PBNJ_QOIENCODER_H
+
+#include "Image.h"
+
+#include <vector>
+
+namespace pbnj {
+
+    /* encodes an image in the Quite OK Image format (qoiformat.org)
+     * lossless like PNG but a single pass with no entropy coding, so it
+     * is many times faster to encode and decode at somewhat larger sizes
+     * pixels are rows top to bottom, stride bytes apart (0 packs them
+     * tightly); RGB images are stored with 3 channels, the rest with 4
+     * returns false and leaves qoi empty if the image is too large
+     */
+    bool encodeQOI(std::vector<unsigned char> &qoi,
+            const unsigned char *pixels, int width, int height,
+            unsigned int stride, PIXELFORMAT format);
+
+    /* decodes a QOI image into image, which is resized and set to RGBA
+     * (or RGB for 3 channel files)
+     * returns false if qoi is not a valid QOI image
+     */
+    bool decodeQOI(const unsigned char *qoi, unsigned long int size,
+            Image &image);
+}
+
+#endif
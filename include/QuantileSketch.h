@@ -0,0 +1,51 @@
+#ifndef PBNJ_QUANTILESKETCH_H
+#define PBNJ_QUANTILESKETCH_H
+
+#include <pbnj.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace pbnj {
+
+    /* approximate quantiles of a stream of floats
+     * values are counted in a fixed number of equal-width buckets that
+     * always span the values seen so far; when a value falls outside them
+     * the buckets are doubled in width (pairs merged) and moved until it
+     * fits, so the error of a quantile stays under about 1/2048 of the
+     * data's range whatever the magnitude of the values
+     * sketches of separate chunks of data can be merged, which lets threads
+     * each fill their own and combine them at the end
+     * infinities are ignored along with NaNs
+     */
+    class QuantileSketch {
+        public:
+            QuantileSketch();
+
+            void add(float value);
+            void merge(const QuantileSketch &other);
+            void clear();
+
+            // q in [0, 1], e.g. 0.99 for the 99th percentile
+            float quantile(float q);
+            unsigned long int getCount();
+
+        private:
+            // the buckets are 2^exponent wide, bucket i counts values in
+            // [(base + i) * width, (base + i + 1) * width)
+            std::vector<uint64_t> counts;
+            int64_t base;
+            int exponent;
+            uint64_t count;
+            float minVal;
+            float maxVal;
+
+            static double index(float value, int exponent);
+            void fit(float low, float high, int exponent);
+            void addBuckets(const std::vector<uint64_t> &other,
+                    int64_t otherBase, int otherExponent);
+    };
+}
+
+#endif
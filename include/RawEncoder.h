@@ -0,0 +1,34 @@
+#ifndef PBNJ_RAWENCODER_H
+#define PBNJ_RAWENCODER_H
+
+#include "Image.h"
+
+#include <vector>
+
+namespace pbnj {
+
+    // bytes in front of the pixels of a raw image
+    const unsigned int RAW_HEADER_SIZE = 16;
+
+    /* stores an image uncompressed behind a small header, for handing
+     * frames to another process or node as fast as they can be copied
+     * the header is the magic "PBNJ", a version byte (1), the
+     * PIXELFORMAT as a byte, two zero bytes, then the width and height
+     * as 32 bit little endian integers; tightly packed rows follow, top
+     * to bottom
+     * pixels are rows top to bottom, stride bytes apart (0 packs them
+     * tightly)
+     */
+    bool encodeRaw(std::vector<unsigned char> &raw,
+            const unsigned char *pixels, int width, int height,
+            unsigned int stride, PIXELFORMAT format);
+
+    /* decodes a raw image into image, which is resized and set to the
+     * stored format
+     * returns false if raw is not a valid raw image
+     */
+    bool decodeRaw(const unsigned char *raw, unsigned long int size,
+            Image &image);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef PBNJ_RENDERCACHE_H
+#define PBNJ_RENDERCACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pbnj {
+
+    // counters kept by a RenderCache since it was created
+    struct RenderCacheStats {
+        // lookups answered from memory or disk
+        unsigned long int hits;
+        // the part of hits read back from the cache directory
+        unsigned long int diskHits;
+        unsigned long int misses;
+        unsigned long int insertions;
+        // images dropped from memory to stay within the byte budget
+        unsigned long int evictions;
+        unsigned long int entries;
+        unsigned long int bytes;
+        unsigned long int byteBudget;
+    };
+
+    /* least recently used cache of encoded images, keyed by a hash of
+     * everything that went into them (see Renderer::setRenderCache)
+     * at most byteBudget bytes of images are kept in memory; if a
+     * directory is given every image is also written there and read back
+     * on a memory miss, so the cache survives restarts and can be shared
+     * by several processes; files in it are never removed by the cache
+     * safe to share between threads and Renderers
+     */
+    class RenderCache {
+        public:
+            RenderCache(unsigned long int byteBudget,
+                    std::string directory = "");
+
+            // copies the image into encoded if it is cached
+            bool find(unsigned long int key,
+                    std::vector<unsigned char> &encoded);
+            void insert(unsigned long int key,
+                    const std::vector<unsigned char> &encoded);
+            // empties the memory cache, the directory is left alone
+            void clear();
+
+            RenderCacheStats getStats();
+
+        private:
+            typedef std::shared_ptr<const std::vector<unsigned char> >
+                CachedImage;
+            typedef std::list<std::pair<unsigned long int, CachedImage> >
+                LRUList;
+
+            // most recently used first
+            LRUList entries;
+            std::unordered_map<unsigned long int, LRUList::iterator> index;
+            unsigned long int byteBudget;
+            unsigned long int bytes;
+            std::string directory;
+
+            unsigned long int hits;
+            unsigned long int diskHits;
+            unsigned long int misses;
+            unsigned long int insertions;
+            unsigned long int evictions;
+
+            std::mutex lock;
+
+            // with the lock held
+            void keep(unsigned long int key, CachedImage image);
+            std::string filename(unsigned long int key);
+    };
+}
+
+#endif
@@ -1,23 +1,48 @@
 #ifndef PBNJ_RENDERER_H
 #define PBNJ_RENDERER_H
 
-// disable using an X display
-#define cimg_display 0
-// force libjpeg usage
-#define cimg_use_jpeg 1 
-
 #include <pbnj.h>
-
+#include <Image.h>
+#include <ImageWriter.h>
+#include <JPEGEncoder.h>
+#include <PNGEncoder.h>
+#include <RenderCache.h>
+#include <QOIEncoder.h>
+#include <RawEncoder.h>
+
+#include <functional>
+#include <future>
+#include <map>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <ospray/ospray.h>
 
-#include "CImg.h"
-
 namespace pbnj {
 
-    enum IMAGETYPE {INVALID, PIXMAP, PNG, JPG};
+    // QOI and RAW are lossless and fast to encode, meant for handing
+    // frames between machines rather than for storage
+    enum IMAGETYPE {INVALID, PIXMAP, PNG, JPG, QOI, RAW};
+
+    // framebuffers kept by a Renderer between frames
+    const unsigned int MAX_POOLED_FRAMEBUFFERS = 4;
+
+    // pixels per band when renderPoster picks the band height
+    const unsigned int POSTER_BAND_PIXELS = 4 * 1024 * 1024;
+
+    // called with each intermediate image of a progressive render (as
+    // laid out by renderToBuffer), its frame number and the variance
+    // estimate, return false to stop refining
+    typedef std::function<bool(const unsigned char *buffer,
+            unsigned int frame, float variance)> ProgressCallback;
+
+    // encoder options, copied along with frames that are encoded on
+    // other threads so the Renderer can change them in the meantime
+    struct EncodeSettings {
+        JPGSettings jpg;
+        PNGSettings png;
+    };
 
     class Renderer {
         public:
@@ -32,13 +57,66 @@ namespace pbnj {
             void setIsosurface(Volume *v, std::vector<float> &isoValues, float specular);
             void setCamera(Camera *c);
             void setSamples(unsigned int spp);
+            // render in square tiles of this many pixels, 0 (the default)
+            // renders the whole image at once
+            void setTileSize(unsigned int size);
+            // compression used for every PNG the Renderer makes
+            void setPNGSettings(const PNGSettings &settings);
+            // JPG quality, chroma subsampling and DCT method; the quality
+            // given to renderToJPGObject overrides the one set here
+            void setJPGSettings(const JPGSettings &settings);
+            // write the images saved by renderImage on a background
+            // thread, with at most maxQueued waiting; 0 (the default)
+            // writes them before renderImage returns
+            void setWriteQueue(unsigned int maxQueued);
+            // blocks until every queued image is written, returns false
+            // if any of them could not be
+            bool flushImages();
+            // answer renderImage and the renderTo*Object functions from
+            // cache when the same scene, camera, samples and output format
+            // were encoded before; the cache can be shared by several
+            // Renderers, NULL (the default) turns caching off
+            void setRenderCache(RenderCache *cache);
 
             void render();
             void renderToBuffer(unsigned char **buffer);
+            // render into memory owned by the caller, which must hold the
+            // camera's image size; a stride of 0 packs the rows tightly
+            bool renderToBuffer(unsigned char *buffer, unsigned int stride,
+                    PIXELFORMAT format, bool composite = true);
+            // resizes image to the camera's image size if needed
+            bool renderToImage(Image &image);
+            float renderProgressive(unsigned char **buffer,
+                    float varianceThreshold, float timeBudget,
+                    unsigned int maxFrames = 256,
+                    ProgressCallback callback = ProgressCallback());
             void renderToJPGObject(std::vector<unsigned char> &jpg, int quality);
             void renderToPNGObject(std::vector<unsigned char> &png);
+            void renderToQOIObject(std::vector<unsigned char> &qoi);
+            void renderToRawObject(std::vector<unsigned char> &raw);
             void renderImage(std::string imageFilename);
+            // render now, composite and encode on another thread
+            std::future<std::vector<unsigned char> > renderAsync(
+                    IMAGETYPE imageType);
+            std::future<void> renderImageAsync(std::string imageFilename);
+            // render one image per camera state, reusing the scene
+            void renderPath(std::vector<CameraState> &path,
+                    std::vector<std::string> &imageFilenames);
+            // render one image per camera state into images, which is
+            // resized to match; the scene is committed once and only the
+            // camera and its light change between views; the camera is
+            // left where it was
+            bool renderBatch(const std::vector<CameraState> &views,
+                    std::vector<Image> &images);
+            // render in bands of rows streamed straight into a PNG or PPM
+            // file, memory use depends on the band size rather than the
+            // image size; 0 picks bands of about POSTER_BAND_PIXELS
+            bool renderPoster(std::string imageFilename,
+                    unsigned int bandHeight = 0);
         private:
+            // renderBatch spreads views over the pool's renderers
+            friend class RendererPool;
+
             unsigned char backgroundColor[4];
 
             OSPRenderer oRenderer;
@@ -59,15 +137,88 @@ namespace pbnj {
             void saveAsPPM(std::string filename);
             void saveAsPNG(std::string filename);
             void saveAsJPG(std::string filename);
+            void saveAsQOI(std::string filename);
+            void saveAsRaw(std::string filename);
             void bufferToPNG(std::vector<unsigned char> &png);
-
-            std::string lastVolumeID;
-            std::string lastCameraID;
+            EncodeSettings encodeSettings;
+            static void encodeBuffer(const unsigned char *buffer, int width,
+                    int height, IMAGETYPE imageType,
+                    const EncodeSettings &settings,
+                    std::vector<unsigned char> &encoded);
+            static void writeBuffer(const unsigned char *buffer, int width,
+                    int height, std::string filename, IMAGETYPE imageType,
+                    const EncodeSettings &settings);
+            // NULL unless setWriteQueue enabled it
+            ImageWriter *imageWriter;
+            // a queue replaced by setWriteQueue failed to write something
+            bool writeFailed;
+            // encodes on the calling thread, then queues or writes it
+            void saveEncoded(std::string filename, IMAGETYPE imageType);
+            RenderCache *renderCache;
+            unsigned long int getCacheKey(IMAGETYPE imageType,
+                    const EncodeSettings &settings);
+            bool renderEncoded(IMAGETYPE imageType,
+                    const EncodeSettings &settings,
+                    std::vector<unsigned char> &encoded);
+            bool prepareFrame();
+            void updateLight(bool force);
+            void renderPrepared();
+            bool renderInto(unsigned char *out, unsigned int stride,
+                    PIXELFORMAT format, const unsigned char *background);
+            bool renderTiles(unsigned char *out, unsigned int stride,
+                    PIXELFORMAT format, const unsigned char *background);
+            bool beginBatch(CameraState &original);
+            bool renderView(const CameraState &view, Image &image);
+            void endBatch(const CameraState &original);
+            // reused by the functions that encode or save each frame
+            Image frameImage;
+            bool renderToRaw(std::vector<unsigned char> &raw);
+            static std::vector<unsigned char> compositeAndEncode(
+                    std::vector<unsigned char> raw, int width, int height,
+                    std::vector<unsigned char> background,
+                    IMAGETYPE imageType, EncodeSettings settings);
+            static void compositeAndSave(std::vector<unsigned char> raw,
+                    int width, int height,
+                    std::vector<unsigned char> background,
+                    IMAGETYPE imageType, std::string filename,
+                    EncodeSettings settings);
+
+            unsigned int tileSize;
+
+            // width, height, format and channels
+            typedef std::tuple<int, int, int, int> FrameBufferKey;
+            struct PooledFrameBuffer {
+                OSPFrameBuffer frameBuffer;
+                // getFrameState() when the accumulated samples started
+                std::vector<unsigned long int> state;
+                unsigned long int lastUse;
+            };
+            std::map<FrameBufferKey, PooledFrameBuffer> frameBuffers;
+            unsigned long int frameBufferUses;
+            // bumped whenever the model or renderer settings change
+            unsigned long int sceneVersion;
+            // what the OSPRay renderer was last committed with, so frames
+            // only commit it again when something changed
+            unsigned long int committedSceneVersion;
+            OSPCamera committedCamera;
+            std::vector<unsigned long int> getFrameState();
+            OSPFrameBuffer getFrameBuffer(int width, int height,
+                    OSPFrameBufferFormat format, int channels,
+                    bool accumulate);
+
+            // the volume of the current model, for the render cache
+            Volume *lastVolume;
+            float lastSpecular;
+            unsigned long int lastVolumeID;
+            unsigned long int lastVolumeVersion;
+            unsigned long int lastCameraID;
+            unsigned long int lastCameraVersion;
             std::string lastRenderType;
             std::vector<float> lastIsoValues;
 
             std::vector<OSPLight> lights;
             float lightDirection[3];
+            float committedLightDirection[3];
             unsigned int samples;
     };
 }
@@ -0,0 +1,84 @@
+#ifndef PBNJ_RENDERERPOOL_H
+#define PBNJ_RENDERERPOOL_H
+
+#include "Renderer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pbnj {
+
+    // counters kept by a RendererPool since it was created
+    struct RendererPoolStats {
+        unsigned int renderers;
+        unsigned int busy;
+        // threads currently waiting for a free renderer
+        unsigned int queued;
+        unsigned int peakQueued;
+        unsigned long int acquisitions;
+        // acquisitions that got the renderer the thread used last time
+        unsigned long int reused;
+        double totalWaitSeconds;
+        double maxWaitSeconds;
+        // fraction of renderer time spent handed out, in [0, 1]
+        double utilisation;
+    };
+
+    /* a fixed set of Renderers handed out to threads
+     * the pool doesn't hold volumes or transfer functions itself; the
+     * OSPRay objects are committed once by each Volume, so giving the same
+     * Volume to every renderer (e.g. in renderBatch's setup) shares them
+     * without copies
+     */
+    class RendererPool {
+
+        public:
+            // 0 creates one renderer per hardware thread
+            RendererPool(unsigned int size = 0);
+            ~RendererPool();
+
+            // blocks until a renderer is free, preferring the one this
+            // thread used last since its model and camera are still set
+            Renderer *acquire();
+            void release(Renderer *renderer);
+            // acquire, call func, release
+            void render(std::function<void(Renderer *)> func);
+            // render views[i] into images[i] spread over up to every
+            // renderer, their OSPRay work takes turns (see OSPRayLock);
+            // each thread acquires a renderer, calls setup to give it the
+            // scene and a Camera of its own, then takes views until none
+            // are left; returns false if any view failed
+            bool renderBatch(const std::vector<CameraState> &views,
+                    std::vector<Image> &images,
+                    std::function<void(Renderer *)> setup);
+
+            unsigned int getSize();
+            RendererPoolStats getStats();
+
+        private:
+            std::vector<Renderer *> renderers;
+            std::vector<bool> inUse;
+            std::vector<std::chrono::steady_clock::time_point> acquiredAt;
+            // the thread each renderer was last handed to
+            std::vector<std::thread::id> lastThread;
+
+            std::mutex lock;
+            std::condition_variable available;
+
+            std::chrono::steady_clock::time_point created;
+            unsigned int queued;
+            unsigned int peakQueued;
+            unsigned long int acquisitions;
+            unsigned long int reused;
+            double totalWaitSeconds;
+            double maxWaitSeconds;
+            double busySeconds;
+    };
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include "Volume.h"
 
 #include <list>
+#include <map>
 #include <string>
 #include <sys/sysinfo.h>
 #include <vector>
@@ -27,13 +28,38 @@ namespace pbnj {
             std::vector<float> colorMap;
             std::vector<float> opacityMap;
             float opacityAttenuation;
+            OPACITYMODE opacityMode;
+            float lowPercentile;
+            float highPercentile;
+            bool preIntegration;
+            float samplingRate;
             bool doMemoryMap;
 
             void setColorMap(std::vector<float> &map);
             void setOpacityMap(std::vector<float> &map);
+            void setAutoOpacityMap(OPACITYMODE mode);
+            void setPercentileRange(float low, float high);
+            void setPreIntegration(bool enabled);
+            void setSamplingRate(float rate);
             void setOpacityAttenuation(float attenuation);
             void setMemoryMapping(bool toMMap);
 
+            /* transfer function keyframes for animating playback
+             * volumes between keyframes get maps interpolated from the
+             * surrounding keyframes, and ones before the first or after the
+             * last keyframe get that keyframe's maps; either map may be
+             * empty to only key the other one
+             * keyframed maps replace colorMap, opacityMap and opacityMode
+             */
+            void addKeyframe(unsigned int timestep,
+                    std::vector<float> &colorMap,
+                    std::vector<float> &opacityMap);
+            // volumes go back to the base maps on their next getVolume
+            void clearKeyframes();
+            // interpolated maps are only uploaded to a volume when some
+            // entry moved by more than this since the last upload
+            void setKeyframeTolerance(float tolerance);
+
         private:
             int xDim;
             int yDim;
@@ -44,6 +70,30 @@ namespace pbnj {
             std::list<int> lruCache;
             void encache(unsigned int index);
 
+            std::map<unsigned int, std::vector<float>> colorKeyframes;
+            std::map<unsigned int, std::vector<float>> opacityKeyframes;
+            float keyframeTolerance;
+            // holds the last interpolated maps that were uploaded, volumes
+            // share its OSPRay data, so a table is uploaded once however
+            // many timesteps use it
+            TransferFunction *keyframeTF;
+            std::vector<int> uploadedColors;
+            std::vector<int> uploadedOpacities;
+            // counts the uploads, each volume remembers the one it shares
+            // and 0 means it has its base maps
+            unsigned long int colorUploads;
+            unsigned long int opacityUploads;
+            std::vector<unsigned long int> appliedColors;
+            std::vector<unsigned long int> appliedOpacities;
+            bool interpolateKeyframes(
+                    std::map<unsigned int, std::vector<float>> &keyframes,
+                    unsigned int timestep, std::vector<float> &map);
+            bool quantizeChanged(std::vector<float> &map,
+                    std::vector<int> &applied);
+            void applyKeyframes(unsigned int index);
+            void applyBaseColor(unsigned int index);
+            void applyBaseOpacity(unsigned int index);
+
             unsigned int length;
             std::vector<std::string> dataFilenames;
             std::string dataVariable;
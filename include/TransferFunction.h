@@ -20,6 +20,19 @@ namespace pbnj {
     extern std::vector<float> reverseExponential;
     extern std::vector<float> flat;
 
+    // opacity maps that can be generated from a data histogram
+    //  - OPACITY_MANUAL: no generation, use a given or named map
+    //  - OPACITY_EQUALIZE: opacity follows the cumulative distribution,
+    //    spreading the opacity ramp evenly over the data
+    //  - OPACITY_RARE: opacity is highest for the least common values,
+    //    hiding dominant background values
+    enum OPACITYMODE {OPACITY_MANUAL, OPACITY_EQUALIZE, OPACITY_RARE};
+
+    // linearly resample a map with the given number of channels per entry
+    // (3 for color maps, 1 for opacity maps) to length entries
+    std::vector<float> resampleMap(std::vector<float> &map,
+            unsigned int channels, unsigned int length);
+
     class TransferFunction {
         public:
             //creates ramp opacity and black to white color
@@ -33,9 +46,25 @@ namespace pbnj {
             // enum for known color maps
 
             void setRange(float minimum, float maximum);
+            float getMinimum();
+            float getMaximum();
             void attenuateOpacity(float amount);
             void setColorMap(std::vector<float> &map);
             void setOpacityMap(std::vector<float> &map);
+            // take the other transfer function's map, sharing its OSPRay
+            // data instead of uploading another copy of it
+            void shareColorMap(TransferFunction *other);
+            void shareOpacityMap(TransferFunction *other);
+            // histogram bins should span the same range given to setRange
+            void setOpacityFromHistogram(
+                    std::vector<unsigned long int> &histogram,
+                    OPACITYMODE mode);
+
+            // incremented by every change to the maps or range
+            unsigned long int getVersion();
+            // hash of the maps and range, unlike the version it is the
+            // same again when the same maps are set again
+            unsigned long int getHash();
 
             OSPTransferFunction asOSPObject();
             
@@ -46,7 +75,12 @@ namespace pbnj {
             float minVal;
             float maxVal;
 
+            unsigned long int version;
+            unsigned long int hash;
+            unsigned long int hashVersion;
+
             OSPTransferFunction oTF;
+            // NULL while the data is shared from another transfer function
             OSPData oColorData;
             OSPData oOpacityData;
     };
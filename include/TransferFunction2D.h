@@ -0,0 +1,76 @@
+#ifndef PBNJ_TRANSFERFUNCTION2D_H
+#define PBNJ_TRANSFERFUNCTION2D_H
+
+#include <pbnj.h>
+
+#include <vector>
+
+namespace pbnj {
+
+    /* transfer function over data value x gradient magnitude
+     * high gradient magnitudes mark boundaries between materials, so this
+     * can tell surfaces and interiors of the same value apart
+     *
+     * OSPRay 1.x only renders scalar volumes through 1D transfer functions
+     * and always interpolates them trilinearly, so there is no way to have
+     * it classify with this table without samples between voxels of
+     * different gradient bins picking up unrelated entries. Instead a
+     * Volume classifies every voxel to RGBA on the CPU, see
+     * Volume::classify(), for use outside of OSPRay
+     */
+    class TransferFunction2D {
+        public:
+            // default is a grayscale ramp whose opacity also ramps up with
+            // gradient magnitude, emphasizing boundaries
+            TransferFunction2D(unsigned int valueBins=256,
+                    unsigned int gradientBins=16);
+
+            // these three are separable: every gradient row gets the same
+            // colors, and opacity is the value opacity times the gradient
+            // opacity; each call rebuilds the whole table
+            void setColorMap(std::vector<float> &map);
+            void setOpacityMap(std::vector<float> &map);
+            void setGradientOpacityMap(std::vector<float> &map);
+            // edit a single cell of the table after the maps are set
+            void setEntry(unsigned int valueBin, unsigned int gradientBin,
+                    float r, float g, float b, float a);
+
+            // gradient magnitudes mapped onto the gradient axis
+            // if never set, a Volume will use 0 to the 99th percentile of
+            // its gradient magnitudes
+            void setGradientRange(float minimum, float maximum);
+            float getGradientMinimum();
+            float getGradientMaximum();
+
+            unsigned int getValueBins();
+            unsigned int getGradientBins();
+            // RGBA for a value and gradient magnitude that are both
+            // normalized to [0, 1]; values are interpolated along their
+            // row, gradients take the nearest row so rows never mix
+            void classify(float value, float gradient, float *rgba);
+            // incremented by every change to the table or range
+            unsigned long int getVersion();
+            // hash of the table and range, the same again when the same
+            // maps are set again
+            unsigned long int getHash();
+
+        private:
+            unsigned int valueBins;
+            unsigned int gradientBins;
+            float gradientMin;
+            float gradientMax;
+            unsigned long int version;
+            unsigned long int hash;
+            unsigned long int hashVersion;
+
+            std::vector<float> colorMap;
+            std::vector<float> opacityMap;
+            std::vector<float> gradientOpacityMap;
+            // valueBins x gradientBins RGBA, value bins vary fastest
+            std::vector<float> table;
+
+            void buildTable();
+    };
+}
+
+#endif
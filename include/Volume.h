@@ -3,6 +3,8 @@
 
 #include <pbnj.h>
 #include <DataFile.h>
+#include <TransferFunction.h>
+#include <TransferFunction2D.h>
 
 #include <string>
 #include <vector>
@@ -24,18 +26,60 @@ namespace pbnj {
             void attenuateOpacity(float amount);
             void setColorMap(std::vector<float> &map);
             void setOpacityMap(std::vector<float> &map);
+            // the histogram is kept, so setting a map again over the same
+            // range doesn't take another pass over the data
+            void setAutoOpacityMap(OPACITYMODE mode);
+            // take a map from tf without uploading another copy of it
+            void shareColorMap(TransferFunction *tf);
+            void shareOpacityMap(TransferFunction *tf);
+            // map colors and opacities over the given percentiles of the
+            // data instead of the full range, so outliers don't squash it
+            void setPercentileRange(float lowPercentile,
+                    float highPercentile);
+            // OSPRay's built-in pre-integrated classification integrates
+            // the transfer function between samples, so sharp opacity maps
+            // need far fewer samples along each ray to avoid banding
+            void setPreIntegration(bool enabled);
+            // samples per voxel along a ray, OSPRay's default is 0.125
+            void setSamplingRate(float rate);
             std::vector<long unsigned int> getBounds();
+            // central difference gradient magnitude of every voxel,
+            // computed on first use and kept for the life of the volume
+            const std::vector<float> &getGradientMagnitude();
             OSPVolume asOSPRayObject();
+            // RGBA of every voxel from a 2D transfer function whose value
+            // axis spans this volume's transfer function range, four floats
+            // per voxel in the data's order; uses the cached gradients
+            void classify(TransferFunction2D *tf, std::vector<float> &rgba);
+            // incremented by every setter, including transfer function ones
+            unsigned long int getVersion();
+            // identifies the file this volume was loaded from (path,
+            // variable, dimensions and modification time) and everything
+            // set on it that changes how it renders, so it is the same in
+            // every process that loads the same data the same way
+            unsigned long int getHash();
 
-            std::string ID;
+            unsigned long int ID;
 
         private:
+            unsigned long int version;
+            bool preIntegration;
+            float samplingRate;
             DataFile *dataFile;
             TransferFunction *transferFunction;
+            // last histogram setAutoOpacityMap used, and the range it spans
+            std::vector<unsigned long int> opacityHistogram;
+            float opacityHistogramRange[2];
 
             OSPVolume oVolume;
             OSPData oData;
 
+            // only filled in if getGradientMagnitude is called
+            std::vector<float> gradientMagnitude;
+            // 99th percentile of the gradient magnitudes, -1 until known
+            float gradientCeiling;
+            void computeGradientMagnitude(float *magnitude);
+
             void init();
             void loadFromFile(std::string filename, std::string var_name="",
                     bool memmap=false);
@@ -17,6 +17,11 @@ namespace pbnj {
      */
     class DataFile;
 
+    /* mergeable approximate quantile summary of a dataset's values
+     * built alongside the other statistics in DataFile
+     */
+    class QuantileSketch;
+
     /* abstraction wrapper around OSPRay volumes */
     class Volume;
 
@@ -28,14 +33,31 @@ namespace pbnj {
      */
     class TransferFunction;
 
+    /* transfer function over data value and gradient magnitude
+     * classifies voxels to RGBA on the CPU
+     */
+    class TransferFunction2D;
+
     /* abstraction wrapper around OSPRay renderer */
     class Renderer;
 
+    /* fixed set of Renderers shared by request handling threads */
+    class RendererPool;
+
+    /* least recently used cache of encoded images, shared by Renderers */
+    class RenderCache;
+
+    /* reusable pixel buffer that Renderers can render into */
+    class Image;
+
     /* abstraction wrapper around OSPRay camera
      * Provides simplified camera movement
      */
     class Camera;
 
+    /* position, view and up of a camera, used for camera paths */
+    struct CameraState;
+
     /* configuration class, uses rapidjson to parse JSON
      * config files
      */
@@ -45,7 +67,28 @@ namespace pbnj {
 
     void pbnjInit(int *argc, const char **argv);
 
-    std::string createID();
+    /* held for as long as it exists, around every OSPRay call pbnj makes
+     * OSPRay 1.x calls are not safe from several threads at once, this
+     * lets Renderers be used from several threads (see RendererPool):
+     * their OSPRay work takes turns while compositing and encoding run in
+     * parallel; it can be taken again by the thread holding it
+     */
+    class OSPRayLock {
+        public:
+            OSPRayLock();
+            ~OSPRayLock();
+        private:
+            OSPRayLock(const OSPRayLock &);
+            OSPRayLock &operator=(const OSPRayLock &);
+    };
+
+    // unique, never zero, safe to call from any thread
+    unsigned long int createID();
+
+    // 64 bit FNV-1a hash of size bytes, continuing from hash so several
+    // values can be hashed together
+    unsigned long int hashBytes(const void *data, unsigned long int size,
+            unsigned long int hash = 14695981039346656037ul);
 }
 
 #endif
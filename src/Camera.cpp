@@ -1,5 +1,6 @@
 #include "Camera.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -8,23 +9,40 @@
 namespace pbnj {
 
 Camera::Camera(int width, int height) :
-    imageWidth(width), imageHeight(height), xPos(0.0), yPos(0.0), zPos(0.0),
-    viewX(0.0), viewY(0.0), viewZ(0.0), orbitRadius(0.0)
+    viewX(0.0), viewY(0.0), viewZ(0.0), version(0), xPos(0.0), yPos(0.0),
+    zPos(0.0), upX(0.0), upY(1.0), upZ(0.0), orbitRadius(0.0),
+    imageWidth(width), imageHeight(height), dirty(true),
+    projection(PERSPECTIVE), fovy(60.0), orthoHeight(1.0), sphereRadius(0.0)
 {
+    OSPRayLock lock;
     this->ID = createID();
+    // the full image by default
+    this->regionStart[0] = 0.0;
+    this->regionStart[1] = 0.0;
+    this->regionEnd[0] = 1.0;
+    this->regionEnd[1] = 1.0;
     //setup OSPRay camera with basic parameters
     this->oCamera = ospNewCamera("perspective");
-    this->updateOSPRayPosition();
-    ospSetf(this->oCamera, "aspect", (float)this->imageWidth/imageHeight);
-    ospCommit(this->oCamera);
+    this->commit();
 }
 
 Camera::~Camera()
 {
+    this->releaseOSPRayCamera();
+}
+
+void Camera::releaseOSPRayCamera()
+{
+    OSPRayLock lock;
     ospRemoveParam(this->oCamera, "aspect");
     ospRemoveParam(this->oCamera, "pos");
     ospRemoveParam(this->oCamera, "dir");
     ospRemoveParam(this->oCamera, "up");
+    ospRemoveParam(this->oCamera, "imageStart");
+    ospRemoveParam(this->oCamera, "imageEnd");
+    ospRemoveParam(this->oCamera, "fovy");
+    ospRemoveParam(this->oCamera, "height");
+    ospRemoveParam(this->oCamera, "nearClip");
     ospRelease(this->oCamera);
 }
 
@@ -32,7 +50,7 @@ void Camera::setOrbitRadius(float radius)
 {
     //for use with paths
     this->orbitRadius = radius;
-    this->updateOSPRayPosition();
+    this->version++;
 }
 
 void Camera::setUpVector(float x, float y, float z)
@@ -40,7 +58,8 @@ void Camera::setUpVector(float x, float y, float z)
     this->upX = x;
     this->upY = y;
     this->upZ = z;    
-    this->updateOSPRayPosition();
+    this->dirty = true;
+    this->version++;
 }
 
 void Camera::setPosition(float x, float y, float z)
@@ -48,7 +67,8 @@ void Camera::setPosition(float x, float y, float z)
     this->xPos = x;
     this->yPos = y;
     this->zPos = z;
-    this->updateOSPRayPosition();
+    this->dirty = true;
+    this->version++;
 }
 
 void Camera::setView(float x, float y, float z)
@@ -56,7 +76,8 @@ void Camera::setView(float x, float y, float z)
     this->viewX = x;
     this->viewY = y;
     this->viewZ = z;
-    this->updateOSPRayPosition();
+    this->dirty = true;
+    this->version++;
 }
 
 void Camera::centerView()
@@ -70,6 +91,8 @@ void Camera::setImageSize(int width, int height)
 {
     this->imageWidth  = width;
     this->imageHeight = height;
+    this->dirty = true;
+    this->version++;
 }
 
 int Camera::getImageWidth()
@@ -82,8 +105,12 @@ int Camera::getImageHeight()
     return this->imageHeight;
 }
 
-void Camera::updateOSPRayPosition()
+void Camera::commit()
 {
+    OSPRayLock lock;
+    if(!this->dirty)
+        return;
+
     //update OSPRay camera
     float position[] = {this->xPos, this->yPos, this->zPos};
     ospSet3fv(this->oCamera, "pos", position);
@@ -93,7 +120,20 @@ void Camera::updateOSPRayPosition()
 
     float up[] = {this->upX, this->upY, this->upZ};
     ospSet3fv(this->oCamera, "up",  up);
+
+    ospSetf(this->oCamera, "aspect", (float)this->imageWidth/imageHeight);
+    ospSet2fv(this->oCamera, "imageStart", this->regionStart);
+    ospSet2fv(this->oCamera, "imageEnd", this->regionEnd);
+    if(this->projection == PERSPECTIVE)
+        ospSetf(this->oCamera, "fovy", this->fovy);
+    else if(this->projection == ORTHOGRAPHIC)
+        ospSetf(this->oCamera, "height", this->orthoHeight);
+    else if(this->projection == INWARD_SPHERICAL)
+        // OSPRay has no inward camera, but a panoramic one whose rays
+        // start sphereRadius behind its position casts exactly those rays
+        ospSetf(this->oCamera, "nearClip", -this->sphereRadius);
     ospCommit(this->oCamera);
+    this->dirty = false;
 }
 
 void Camera::setRegion(float top, float right, float bottom, float left)
@@ -104,10 +144,80 @@ void Camera::setRegion(float top, float right, float bottom, float left)
     // top right of the full image is [1, 1]
     // e.g. the upper left quadrant of the image would be defined with
     // setRegion(1, 0.5, 0.5, 0)
-    float upperRight[] = {right, top};
-    float lowerLeft[] = {left, bottom};
-    ospSet2fv(this->oCamera, "imageStart", lowerLeft);
-    ospSet2fv(this->oCamera, "imageEnd", upperRight);
+    this->regionStart[0] = left;
+    this->regionStart[1] = bottom;
+    this->regionEnd[0] = right;
+    this->regionEnd[1] = top;
+    this->dirty = true;
+    this->version++;
+}
+
+void Camera::getRegion(float &top, float &right, float &bottom,
+        float &left)
+{
+    left = this->regionStart[0];
+    bottom = this->regionStart[1];
+    right = this->regionEnd[0];
+    top = this->regionEnd[1];
+}
+
+void Camera::setProjection(CAMERATYPE type)
+{
+    OSPRayLock lock;
+    if(type == this->projection)
+        return;
+
+    // OSPRay can't change a camera's type, so start over with a new one
+    // carrying the same state
+    this->releaseOSPRayCamera();
+    if(type == PANORAMIC || type == INWARD_SPHERICAL)
+        this->oCamera = ospNewCamera("panoramic");
+    else if(type == ORTHOGRAPHIC)
+        this->oCamera = ospNewCamera("orthographic");
+    else
+        this->oCamera = ospNewCamera("perspective");
+    this->projection = type;
+    this->dirty = true;
+    this->version++;
+}
+
+CAMERATYPE Camera::getProjection()
+{
+    return this->projection;
+}
+
+void Camera::setFieldOfView(float degrees)
+{
+    if(degrees <= 0 || degrees >= 180) {
+        std::cerr << "Field of view must be in (0, 180) degrees!";
+        std::cerr << std::endl;
+        return;
+    }
+    this->fovy = degrees;
+    this->dirty = true;
+    this->version++;
+}
+
+void Camera::setOrthographicHeight(float height)
+{
+    if(height <= 0) {
+        std::cerr << "Orthographic height must be positive!" << std::endl;
+        return;
+    }
+    this->orthoHeight = height;
+    this->dirty = true;
+    this->version++;
+}
+
+void Camera::setSphereRadius(float radius)
+{
+    if(radius < 0) {
+        std::cerr << "Sphere radius can't be negative!" << std::endl;
+        return;
+    }
+    this->sphereRadius = radius;
+    this->dirty = true;
+    this->version++;
 }
 
 OSPCamera Camera::asOSPRayObject()
@@ -115,4 +225,252 @@ OSPCamera Camera::asOSPRayObject()
     return this->oCamera;
 }
 
+unsigned long int Camera::getVersion()
+{
+    return this->version;
+}
+
+unsigned long int Camera::getHash()
+{
+    float values[] = {this->xPos, this->yPos, this->zPos, this->viewX,
+        this->viewY, this->viewZ, this->upX, this->upY, this->upZ,
+        this->regionStart[0], this->regionStart[1], this->regionEnd[0],
+        this->regionEnd[1], this->fovy, this->orthoHeight,
+        this->sphereRadius};
+    int layout[] = {this->imageWidth, this->imageHeight,
+        (int)this->projection};
+    unsigned long int hash = hashBytes(values, sizeof(values));
+    return hashBytes(layout, sizeof(layout), hash);
+}
+
+CameraState Camera::getState()
+{
+    CameraState state = {{this->xPos, this->yPos, this->zPos},
+        {this->viewX, this->viewY, this->viewZ},
+        {this->upX, this->upY, this->upZ}};
+    return state;
+}
+
+void Camera::setState(const CameraState &state)
+{
+    this->xPos = state.position[0];
+    this->yPos = state.position[1];
+    this->zPos = state.position[2];
+    this->viewX = state.view[0];
+    this->viewY = state.view[1];
+    this->viewZ = state.view[2];
+    this->upX = state.up[0];
+    this->upY = state.up[1];
+    this->upZ = state.up[2];
+    this->dirty = true;
+    this->version++;
+}
+
+// rotate v by angle radians about the unit vector axis (Rodrigues)
+static void rotate(const float *v, const float *axis, float angle, float *out)
+{
+    float c = std::cos(angle), s = std::sin(angle);
+    float dot = v[0]*axis[0] + v[1]*axis[1] + v[2]*axis[2];
+    float cross[3] = {axis[1]*v[2] - axis[2]*v[1],
+                      axis[2]*v[0] - axis[0]*v[2],
+                      axis[0]*v[1] - axis[1]*v[0]};
+    for(int i = 0; i < 3; i++)
+        out[i] = v[i]*c + cross[i]*s + axis[i]*dot*(1 - c);
+}
+
+static float normalize(float *v)
+{
+    float length = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if(length > 0)
+        for(int i = 0; i < 3; i++)
+            v[i] /= length;
+    return length;
+}
+
+void Camera::setPath(PATHTYPE type, unsigned int frames)
+{
+    this->path.clear();
+    if(frames == 0)
+        return;
+
+    float position[3] = {this->xPos, this->yPos, this->zPos};
+    float up[3] = {this->upX, this->upY, this->upZ};
+    normalize(up);
+    // pick the circle's axis and the part of the position that rotates
+    float axis[3], start[3], offset[3] = {0, 0, 0};
+    if(type == ORBIT) {
+        // rotate about the up vector, keeping the height along it
+        float height = position[0]*up[0] + position[1]*up[1] +
+            position[2]*up[2];
+        for(int i = 0; i < 3; i++) {
+            axis[i] = up[i];
+            offset[i] = height * up[i];
+            start[i] = position[i] - offset[i];
+        }
+    }
+    else {
+        // rotate about the axis perpendicular to the position and up
+        axis[0] = position[1]*up[2] - position[2]*up[1];
+        axis[1] = position[2]*up[0] - position[0]*up[2];
+        axis[2] = position[0]*up[1] - position[1]*up[0];
+        for(int i = 0; i < 3; i++)
+            start[i] = position[i];
+    }
+    float radius = normalize(start);
+    if(this->orbitRadius > 0)
+        radius = this->orbitRadius;
+    if(normalize(axis) == 0 || radius == 0) {
+        std::cerr << "Camera position is on the path's axis, can't make ";
+        std::cerr << "a path!" << std::endl;
+        return;
+    }
+
+    this->path.reserve(frames);
+    for(unsigned int f = 0; f < frames; f++) {
+        float angle = 2 * M_PI * f / frames;
+        CameraState state;
+        rotate(start, axis, angle, state.position);
+        for(int i = 0; i < 3; i++) {
+            state.position[i] = offset[i] + radius * state.position[i];
+            // always look at the volume center
+            state.view[i] = -state.position[i];
+        }
+        // the up vector turns with a great circle so it can pass the poles
+        if(type == GREAT_CIRCLE)
+            rotate(up, axis, angle, state.up);
+        else
+            for(int i = 0; i < 3; i++)
+                state.up[i] = up[i];
+        this->path.push_back(state);
+    }
+}
+
+// Catmull-Rom interpolation of n floats between p1 and p2
+static void catmullRom(const float *p0, const float *p1, const float *p2,
+        const float *p3, float t, int n, float *out)
+{
+    float t2 = t*t, t3 = t2*t;
+    for(int i = 0; i < n; i++)
+        out[i] = 0.5 * (2*p1[i] + (p2[i] - p0[i])*t +
+                (2*p0[i] - 5*p1[i] + 4*p2[i] - p3[i])*t2 +
+                (3*p1[i] - p0[i] - 3*p2[i] + p3[i])*t3);
+}
+
+void Camera::setPath(std::vector<CameraState> &keyframes, unsigned int frames)
+{
+    this->path.clear();
+    if(frames == 0 || keyframes.empty())
+        return;
+    if(keyframes.size() == 1) {
+        this->path.assign(frames, keyframes[0]);
+        return;
+    }
+
+    unsigned int last = keyframes.size() - 1;
+    this->path.reserve(frames);
+    for(unsigned int f = 0; f < frames; f++) {
+        // position along the whole spline, in keyframe units
+        float s = frames > 1 ? last * f / (float)(frames - 1) : 0;
+        unsigned int k = std::min((unsigned int) s, last - 1);
+        float t = s - k;
+        // the end keyframes stand in for their missing neighbours
+        const CameraState &k0 = keyframes[k > 0 ? k - 1 : 0];
+        const CameraState &k1 = keyframes[k];
+        const CameraState &k2 = keyframes[k + 1];
+        const CameraState &k3 = keyframes[std::min(k + 2, last)];
+        CameraState state;
+        catmullRom(k0.position, k1.position, k2.position, k3.position, t, 3,
+                state.position);
+        catmullRom(k0.view, k1.view, k2.view, k3.view, t, 3, state.view);
+        catmullRom(k0.up, k1.up, k2.up, k3.up, t, 3, state.up);
+        this->path.push_back(state);
+    }
+}
+
+std::vector<CameraState> &Camera::getPath()
+{
+    return this->path;
+}
+
+void Camera::frameVolume(Volume *v, float margin)
+{
+    if(this->projection == PANORAMIC) {
+        std::cerr << "Panoramic cameras see everything, nothing to frame!";
+        std::cerr << std::endl;
+        return;
+    }
+
+    //look along the current view direction, or toward the volume center
+    //from the current position if no view was set
+    float dir[3] = {this->viewX, this->viewY, this->viewZ};
+    if(normalize(dir) == 0) {
+        dir[0] = -this->xPos; dir[1] = -this->yPos; dir[2] = -this->zPos;
+        if(normalize(dir) == 0) {
+            dir[0] = 0; dir[1] = 0; dir[2] = -1;
+        }
+    }
+    //image plane basis, right = dir x up and up' = right x dir
+    float up[3] = {this->upX, this->upY, this->upZ};
+    float right[3] = {dir[1]*up[2] - dir[2]*up[1],
+        dir[2]*up[0] - dir[0]*up[2], dir[0]*up[1] - dir[1]*up[0]};
+    if(normalize(right) == 0) {
+        std::cerr << "Up vector is parallel to the view direction!";
+        std::cerr << std::endl;
+        return;
+    }
+    float trueUp[3] = {right[1]*dir[2] - right[2]*dir[1],
+        right[2]*dir[0] - right[0]*dir[2], right[0]*dir[1] - right[1]*dir[0]};
+
+    //volumes are centered on the origin, so the corners are at
+    //+/- half the bounds on each axis
+    std::vector<long unsigned int> bounds = v->getBounds();
+    float half[3] = {bounds[0]/(float)2.0, bounds[1]/(float)2.0,
+        bounds[2]/(float)2.0};
+
+    if(this->projection == INWARD_SPHERICAL) {
+        //every ray passes through the center, so only the sphere they
+        //start from has to clear the corners
+        this->sphereRadius = margin * std::sqrt(half[0]*half[0] +
+                half[1]*half[1] + half[2]*half[2]);
+        this->setPosition(0, 0, 0);
+        this->setView(dir[0], dir[1], dir[2]);
+        this->setUpVector(trueUp[0], trueUp[1], trueUp[2]);
+        return;
+    }
+
+    float aspect = (float)this->imageWidth/this->imageHeight;
+    float tanY = std::tan(this->fovy * (float)M_PI / 360);
+    float tanX = tanY * aspect;
+    float distance = 0.0, extentX = 0.0, extentY = 0.0, depth = 0.0;
+    for(int corner = 0; corner < 8; corner++) {
+        float p[3] = {(corner & 1) ? half[0] : -half[0],
+            (corner & 2) ? half[1] : -half[1],
+            (corner & 4) ? half[2] : -half[2]};
+        float x = std::fabs(p[0]*right[0] + p[1]*right[1] + p[2]*right[2]);
+        float y = std::fabs(p[0]*trueUp[0] + p[1]*trueUp[1] +
+                p[2]*trueUp[2]);
+        //distance of the corner toward the camera
+        float z = -(p[0]*dir[0] + p[1]*dir[1] + p[2]*dir[2]);
+        //the camera must be far enough back for this corner to fit in
+        //both the horizontal and vertical field of view
+        distance = std::max(distance,
+                std::max(x*margin/tanX, y*margin/tanY) + z);
+        extentX = std::max(extentX, x);
+        extentY = std::max(extentY, y);
+        depth = std::max(depth, z);
+    }
+
+    if(this->projection == ORTHOGRAPHIC) {
+        //position only needs to be in front of the volume, the visible
+        //area is set by the image plane height
+        distance = depth + 1;
+        this->orthoHeight = 2 * margin * std::max(extentY, extentX/aspect);
+    }
+
+    this->setPosition(-dir[0]*distance, -dir[1]*distance,
+            -dir[2]*distance);
+    this->setView(dir[0], dir[1], dir[2]);
+    this->setUpVector(trueUp[0], trueUp[1], trueUp[2]);
+}
+
 }
@@ -0,0 +1,223 @@
+#include "Composite.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PBNJ_COMPOSITE_X86
+#include <immintrin.h>
+#endif
+
+namespace pbnj {
+
+/*
+ * Every channel is blended as (c * a + b * (255 - a)) / 255, where a is the
+ * pixel's alpha and b the background color premultiplied by its alpha.
+ * The alpha channel itself uses c = 255 and b = background alpha. The sum
+ * never exceeds 255 * 255, so it fits in 16 bits.
+ */
+
+// exact rounded division by 255 for x <= 255 * 255
+static inline unsigned int div255(unsigned int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void compositeScalar(const unsigned char *in, unsigned char *out,
+        int count, const uint16_t *bg)
+{
+    for(int i = 0; i < count; i++) {
+        unsigned int a = in[4*i + 3], inv = 255 - a;
+        out[4*i + 0] = div255(in[4*i + 0] * a + bg[0] * inv);
+        out[4*i + 1] = div255(in[4*i + 1] * a + bg[1] * inv);
+        out[4*i + 2] = div255(in[4*i + 2] * a + bg[2] * inv);
+        out[4*i + 3] = div255(255 * a + bg[3] * inv);
+    }
+}
+
+#ifdef PBNJ_COMPOSITE_X86
+
+// blends two pixels held as 16 bit lanes
+static inline __m128i blend2SSE(__m128i px, __m128i bg, __m128i alphaMask,
+        __m128i c255)
+{
+    // broadcast each pixel's alpha to its four lanes
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px,
+                _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i c = _mm_or_si128(_mm_andnot_si128(alphaMask, px),
+            _mm_and_si128(alphaMask, c255));
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(c, a),
+            _mm_mullo_epi16(bg, _mm_sub_epi16(c255, a)));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static void compositeSSE2(const unsigned char *in, unsigned char *out,
+        int count, const uint16_t *bg)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i c255 = _mm_set1_epi16(255);
+    __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i bgLanes = _mm_set_epi16(bg[3], bg[2], bg[1], bg[0],
+            bg[3], bg[2], bg[1], bg[0]);
+    int i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)&in[4*i]);
+        __m128i lo = blend2SSE(_mm_unpacklo_epi8(px, zero), bgLanes,
+                alphaMask, c255);
+        __m128i hi = blend2SSE(_mm_unpackhi_epi8(px, zero), bgLanes,
+                alphaMask, c255);
+        _mm_storeu_si128((__m128i *)&out[4*i], _mm_packus_epi16(lo, hi));
+    }
+    compositeScalar(&in[4*i], &out[4*i], count - i, bg);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend4AVX2(__m256i px, __m256i bg, __m256i alphaMask,
+        __m256i c255)
+{
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px,
+                _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i c = _mm256_blendv_epi8(px, c255, alphaMask);
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(c, a),
+            _mm256_mullo_epi16(bg, _mm256_sub_epi16(c255, a)));
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)),
+            8);
+}
+
+__attribute__((target("avx2")))
+static void compositeAVX2(const unsigned char *in, unsigned char *out,
+        int count, const uint16_t *bg)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c255 = _mm256_set1_epi16(255);
+    __m256i alphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0,
+            -1, 0, 0, 0, -1, 0, 0, 0);
+    __m256i bgLanes = _mm256_set_epi16(bg[3], bg[2], bg[1], bg[0],
+            bg[3], bg[2], bg[1], bg[0], bg[3], bg[2], bg[1], bg[0],
+            bg[3], bg[2], bg[1], bg[0]);
+    int i = 0;
+    // unpack and pack both work within 128 bit halves, so the pixel
+    // order comes back out unchanged
+    for(; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)&in[4*i]);
+        __m256i lo = blend4AVX2(_mm256_unpacklo_epi8(px, zero), bgLanes,
+                alphaMask, c255);
+        __m256i hi = blend4AVX2(_mm256_unpackhi_epi8(px, zero), bgLanes,
+                alphaMask, c255);
+        _mm256_storeu_si256((__m256i *)&out[4*i],
+                _mm256_packus_epi16(lo, hi));
+    }
+    compositeSSE2(&in[4*i], &out[4*i], count - i, bg);
+}
+
+#endif
+
+typedef void (*CompositeKernel)(const unsigned char *, unsigned char *, int,
+        const uint16_t *);
+
+// picked once, the first time anything is composited
+static CompositeKernel getKernel()
+{
+#ifdef PBNJ_COMPOSITE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return compositeAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return compositeSSE2;
+#endif
+    return compositeScalar;
+}
+
+static void backgroundTerms(const unsigned char *background, uint16_t *bg)
+{
+    // premultiply the background color by its own alpha once
+    for(int c = 0; c < 3; c++)
+        bg[c] = div255(background[c] * background[3]);
+    bg[3] = background[3];
+}
+
+void compositeRow(const unsigned char *in, unsigned char *out, int count,
+        const unsigned char *background)
+{
+    static CompositeKernel kernel = getKernel();
+    uint16_t bg[4];
+    backgroundTerms(background, bg);
+    kernel(in, out, count, bg);
+}
+
+// RGBA pixels to another format, in and out may be the same for BGRA
+static void convertPixels(const unsigned char *in, unsigned char *out,
+        int count, PIXELFORMAT format)
+{
+    if(format == RGBA) {
+        if(in != out)
+            memcpy(out, in, 4*count);
+    }
+    else if(format == BGRA) {
+        for(int i = 0; i < count; i++) {
+            unsigned char r = in[4*i + 0];
+            out[4*i + 0] = in[4*i + 2];
+            out[4*i + 1] = in[4*i + 1];
+            out[4*i + 2] = r;
+            out[4*i + 3] = in[4*i + 3];
+        }
+    }
+    else if(format == RGB) {
+        for(int i = 0; i < count; i++) {
+            out[3*i + 0] = in[4*i + 0];
+            out[3*i + 1] = in[4*i + 1];
+            out[3*i + 2] = in[4*i + 2];
+        }
+    }
+}
+
+// pixels composited at a time when the output isn't RGBA
+static const int CHUNK_PIXELS = 256;
+
+void compositeImage(const unsigned char *in, int inWidth, int inHeight,
+        unsigned char *out, unsigned int outStride, int outHeight, int x,
+        int y, const unsigned char *background, PIXELFORMAT format)
+{
+    static CompositeKernel kernel = getKernel();
+    uint16_t bg[4];
+    if(background != NULL)
+        backgroundTerms(background, bg);
+    unsigned int outBytes = bytesPerPixel(format);
+
+    // bands of rows per thread, small images aren't worth the threads
+    unsigned long int minRows = 1 + (64 * 1024) / (inWidth + 1);
+    parallelFor(inHeight, [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        unsigned char chunk[4 * CHUNK_PIXELS];
+        for(unsigned long int j = start; j < end; j++) {
+            const unsigned char *rowIn = &in[4*j*inWidth];
+            long int row = outHeight - 1 - (y + (long int)j);
+            unsigned char *rowOut = &out[row*outStride + outBytes*x];
+            if(background == NULL)
+                convertPixels(rowIn, rowOut, inWidth, format);
+            else if(format == RGBA)
+                kernel(rowIn, rowOut, inWidth, bg);
+            else if(format == BGRA) {
+                kernel(rowIn, rowOut, inWidth, bg);
+                convertPixels(rowOut, rowOut, inWidth, format);
+            }
+            else {
+                // RGB rows are too short to composite into, go through a
+                // small buffer on the stack instead
+                for(int i = 0; i < inWidth; i += CHUNK_PIXELS) {
+                    int count = std::min(CHUNK_PIXELS, inWidth - i);
+                    kernel(&rowIn[4*i], chunk, count, bg);
+                    convertPixels(chunk, &rowOut[3*i], count, format);
+                }
+            }
+        }
+    }, minRows);
+}
+
+}
@@ -110,6 +110,7 @@ Configuration::Configuration(rapidjson::Document& json)
         this->selectColorMap(json["colorMap"].GetString());
 
     // opacity map is a ramp by default, otherwise get a list from the user
+    this->opacityMode = OPACITY_MANUAL;
     if(json.HasMember("opacityMap")) {
         // opacity map can either be explicit or a named array
         if(json["opacityMap"].IsArray()) {
@@ -128,6 +129,31 @@ Configuration::Configuration(rapidjson::Document& json)
     else
         this->opacityAttenuation = 1.0;
 
+    // percentiles of the data to stretch the transfer function across
+    // the full data range is used by default
+    if(json.HasMember("valueRangePercentiles")) {
+        const rapidjson::Value& percentiles = json["valueRangePercentiles"];
+        this->lowPercentile = percentiles[0].GetFloat();
+        this->highPercentile = percentiles[1].GetFloat();
+    }
+    else {
+        this->lowPercentile = 0.0;
+        this->highPercentile = 100.0;
+    }
+
+    // pre-integrated transfer function lookups, which allow a coarser
+    // sampling rate along each ray for the same image quality
+    if(json.HasMember("preIntegration"))
+        this->preIntegration = json["preIntegration"].GetBool();
+    else
+        this->preIntegration = false;
+
+    // volume samples per voxel along each ray, OSPRay's default is 0.125
+    if(json.HasMember("samplingRate"))
+        this->samplingRate = json["samplingRate"].GetFloat();
+    else
+        this->samplingRate = 0.125;
+
     // samples per pixel
     if(json.HasMember("samplesPerPixel")) {
         unsigned int val = json["samplesPerPixel"].GetUint();
@@ -136,6 +162,31 @@ Configuration::Configuration(rapidjson::Document& json)
     else
         this->samples = 4;
 
+    // render in tiles of this many pixels, 0 renders the whole image
+    if(json.HasMember("tileSize"))
+        this->tileSize = json["tileSize"].GetUint();
+    else
+        this->tileSize = 0;
+
+    // stream the image to disk in bands of this many rows, 0 renders it
+    // in one piece
+    if(json.HasMember("posterBandHeight"))
+        this->posterBandHeight = json["posterBandHeight"].GetUint();
+    else
+        this->posterBandHeight = 0;
+
+    // PNG compression preset, trading file size for encoding time
+    if(json.HasMember("pngCompression")) {
+        std::string preset = json["pngCompression"].GetString();
+        if(preset == "fast")
+            this->pngSettings = PNGSettings::fast();
+        else if(preset == "best")
+            this->pngSettings = PNGSettings::best();
+        else if(preset != "default")
+            std::cerr << "Unknown pngCompression " << preset
+                << ", using default" << std::endl;
+    }
+
     // allow a camera position, else use the camera's default of 0,0,0
     if(json.HasMember("cameraPosition")) {
         const rapidjson::Value& cameraPos = json["cameraPosition"];
@@ -261,6 +312,16 @@ void Configuration::selectOpacityMap(std::string userInput)
     else if(userInput == "flat") {
         this->opacityMap = flat;
     }
+    // these are generated from the data's histogram once it's loaded
+    else if(userInput == "equalize" ||
+            userInput == "equalized" ||
+            userInput == "histogram equalization") {
+        this->opacityMode = OPACITY_EQUALIZE;
+    }
+    else if(userInput == "rare" ||
+            userInput == "rare values") {
+        this->opacityMode = OPACITY_RARE;
+    }
     else {
         // will default to ramp
         std::cerr << "Unrecognized opacity map " << userInput << "!";
@@ -1,4 +1,5 @@
 #include "DataFile.h"
+#include "Parallel.h"
 
 #include <cmath>
 #include <iostream>
@@ -9,6 +10,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <algorithm>
 
@@ -20,7 +22,8 @@
 namespace pbnj {
 
 DataFile::DataFile(int x, int y, int z) :
-    xDim(x), yDim(y), zDim(z), numValues(x*y*z), statsCalculated(false)
+    modifiedTime(0), xDim(x), yDim(y), zDim(z), numValues(x*y*z),
+    statsCalculated(false)
 {
     this->numValues = xDim * yDim * zDim;
 }
@@ -44,7 +47,13 @@ void DataFile::loadFromFile(std::string filename, std::string var_name,
 {
     //check if the filetype is known
     this->filename = filename;
+    this->variable = var_name;
     this->filetype = getFiletype();
+    // lets caches tell a rewritten file from the one they saw before
+    struct stat fileStat;
+    this->modifiedTime = 0;
+    if(stat(filename.c_str(), &fileStat) == 0)
+        this->modifiedTime = fileStat.st_mtime;
 
     if(this->filetype == UNKNOWN) {
         std::cerr << "Unknown filetype!" << std::endl;
@@ -64,6 +73,7 @@ void DataFile::loadFromFile(std::string filename, std::string var_name,
         else {
             variable = dataFile.getVar(var_name);
         }
+        this->variable = variable.getName();
 
         // overwrite any configured values with the file's values
         this->xDim = (long unsigned int) variable.getDim(2).getSize();
@@ -135,16 +145,46 @@ void DataFile::calculateStatistics()
 {
     // calculate min, max, avg, stddev
     // stddev and avg may be useful for automatic diverging color maps
-    this->minVal = data[0];
-    this->maxVal = data[0];
+    // the quantile sketch gives percentiles for robust value ranges
+    // each thread summarizes its own chunk, then the summaries are merged
+    unsigned int numThreads = getNumThreads();
+    std::vector<float> mins(numThreads, this->data[0]);
+    std::vector<float> maxs(numThreads, this->data[0]);
+    std::vector<double> totals(numThreads, 0), totalsSquares(numThreads, 0);
+    std::vector<QuantileSketch> sketches(numThreads);
+
+    parallelFor(this->numValues,
+            [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        float localMin = this->data[start], localMax = this->data[start];
+        double total = 0, totalSquares = 0;
+        QuantileSketch &sketch = sketches[thread];
+        for(unsigned long int i = start; i < end; i++) {
+            if(this->data[i] < localMin)
+                localMin = this->data[i];
+            if(this->data[i] > localMax)
+                localMax = this->data[i];
+            total += this->data[i];
+            totalSquares += this->data[i]*this->data[i];
+            sketch.add(this->data[i]);
+        }
+        mins[thread] = localMin;
+        maxs[thread] = localMax;
+        totals[thread] = total;
+        totalsSquares[thread] = totalSquares;
+    }, 1 << 16);
+
+    this->minVal = mins[0];
+    this->maxVal = maxs[0];
     double total = 0, totalSquares = 0;
-    for(int i = 1; i < this->numValues; i++) {
-        if(data[i] < this->minVal)
-            this->minVal = data[i];
-        if(data[i] > this->maxVal)
-            this->maxVal = data[i];
-        total += data[i];
-        totalSquares += data[i]*data[i];
+    this->valueSketch.clear();
+    // threads that got no chunk still hold their neutral starting values
+    for(unsigned int t = 0; t < numThreads; t++) {
+        this->minVal = std::min(this->minVal, mins[t]);
+        this->maxVal = std::max(this->maxVal, maxs[t]);
+        total += totals[t];
+        totalSquares += totalsSquares[t];
+        this->valueSketch.merge(sketches[t]);
     }
     this->avgVal = total / this->numValues;
     this->stdDev = std::sqrt(totalSquares/this->numValues -
@@ -152,6 +192,18 @@ void DataFile::calculateStatistics()
     this->statsCalculated = true;
 }
 
+float DataFile::percentile(float p)
+{
+    if(!this->statsCalculated)
+        this->calculateStatistics();
+    // the ends are known exactly
+    if(p <= 0.0)
+        return this->minVal;
+    if(p >= 100.0)
+        return this->maxVal;
+    return this->valueSketch.quantile(p / 100.0);
+}
+
 void DataFile::printStatistics()
 {
     // debugging purposes
@@ -170,27 +222,55 @@ void DataFile::printStatistics()
     std::cout << "std. dev.:  " << this->stdDev << std::endl;
 }
 
-// experimental
-void DataFile::bin(unsigned int num_bins)
+std::vector<unsigned long int> DataFile::histogram(unsigned int num_bins)
 {
     if(!this->statsCalculated)
         this->calculateStatistics();
+    return this->histogram(num_bins, this->minVal, this->maxVal);
+}
 
-    float bin_width = (this->maxVal - this->minVal) / num_bins;
-    unsigned int *histogram = (unsigned int *) calloc(num_bins, 
-            sizeof(unsigned int));
+std::vector<unsigned long int> DataFile::histogram(unsigned int num_bins,
+        float minimum, float maximum)
+{
+    std::vector<unsigned long int> counts(num_bins, 0);
+    if(num_bins == 0 || minimum > maximum)
+        return counts;
 
-    for(int i = 0; i < this->numValues; i++) {
-        float bin = (this->data[i] - this->minVal) / bin_width;
-        unsigned int hist_index = std::min(num_bins - 1, (unsigned int) bin);
-        histogram[hist_index]++;
-    }
+    // a range of one value puts everything in that value in the first bin
+    float range = maximum - minimum;
+    float scale = range > 0 ? num_bins / range : 0;
 
-    std::cout << "Calculated histogram:" << std::endl;
-    for(int i = 0; i < num_bins; i++)
-        std::cout << histogram[i] << std::endl;
+    // each thread fills its own histogram so there's no contention on
+    // the bins, then the partial histograms are summed
+    std::vector<std::vector<unsigned long int>> partials(getNumThreads(),
+            std::vector<unsigned long int>(num_bins, 0));
+    parallelFor(this->numValues,
+            [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        unsigned long int *local = partials[thread].data();
+        for(unsigned long int i = start; i < end; i++) {
+            if(this->data[i] < minimum || this->data[i] > maximum)
+                continue;
+            unsigned int bin = (this->data[i] - minimum) * scale;
+            local[std::min(num_bins - 1, bin)]++;
+        }
+    }, 1 << 16);
+
+    for(unsigned int t = 0; t < partials.size(); t++)
+        for(unsigned int b = 0; b < num_bins; b++)
+            counts[b] += partials[t][b];
+
+    return counts;
+}
 
-    free(histogram);
+// experimental
+void DataFile::bin(unsigned int num_bins)
+{
+    std::vector<unsigned long int> counts = this->histogram(num_bins);
+
+    std::cout << "Calculated histogram:" << std::endl;
+    for(unsigned int i = 0; i < counts.size(); i++)
+        std::cout << counts[i] << std::endl;
 }
 
 }
@@ -0,0 +1,100 @@
+#include "Image.h"
+
+#include <iostream>
+
+namespace pbnj {
+
+unsigned int bytesPerPixel(PIXELFORMAT format)
+{
+    if(format == RGB)
+        return 3;
+    return 4;
+}
+
+Image::Image() :
+    width(0), height(0), format(RGBA), requestedStride(0), stride(0),
+    composite(true)
+{
+}
+
+Image::Image(int width, int height, PIXELFORMAT format,
+        unsigned int stride) :
+    width(width), height(height), format(format), requestedStride(stride),
+    stride(0), composite(true)
+{
+    this->layout();
+}
+
+void Image::layout()
+{
+    unsigned int rowBytes = bytesPerPixel(this->format) * this->width;
+    this->stride = rowBytes;
+    if(this->requestedStride > 0) {
+        if(this->requestedStride < rowBytes)
+            std::cerr << "Image stride is shorter than a row, ignoring it!"
+                << std::endl;
+        else
+            this->stride = this->requestedStride;
+    }
+    // resize never gives memory back, so shrinking and growing again
+    // up to the largest size used doesn't allocate
+    this->data.resize((unsigned long int)this->stride * this->height);
+}
+
+void Image::resize(int width, int height)
+{
+    if(width == this->width && height == this->height)
+        return;
+    this->width = width;
+    this->height = height;
+    this->layout();
+}
+
+void Image::setFormat(PIXELFORMAT format)
+{
+    this->format = format;
+    this->layout();
+}
+
+void Image::setStride(unsigned int stride)
+{
+    this->requestedStride = stride;
+    this->layout();
+}
+
+void Image::setComposite(bool composite)
+{
+    this->composite = composite;
+}
+
+unsigned char *Image::getData()
+{
+    return this->data.data();
+}
+
+int Image::getWidth()
+{
+    return this->width;
+}
+
+int Image::getHeight()
+{
+    return this->height;
+}
+
+unsigned int Image::getStride()
+{
+    return this->stride;
+}
+
+PIXELFORMAT Image::getFormat()
+{
+    return this->format;
+}
+
+bool Image::getComposite()
+{
+    return this->composite;
+}
+
+}
@@ -0,0 +1,110 @@
+#include "ImageWriter.h"
+
+#include <iostream>
+
+#include <stdio.h>
+
+namespace pbnj {
+
+// stdio buffer for image files, whole frames go out in a few large writes
+static const unsigned int WRITE_BUFFER_SIZE = 1 << 20;
+
+ImageWriter::ImageWriter(unsigned int maxQueued) :
+    maxQueued(maxQueued), writing(false), stopping(false), failures(0)
+{
+    if(this->maxQueued == 0)
+        this->maxQueued = 1;
+    this->thread = std::thread(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->changed.notify_all();
+    this->thread.join();
+}
+
+void ImageWriter::write(std::string filename,
+        std::vector<unsigned char> &encoded)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while(this->queue.size() >= this->maxQueued)
+        this->changed.wait(guard);
+    this->queue.push_back(QueuedImage(filename,
+                std::vector<unsigned char>()));
+    this->queue.back().second.swap(encoded);
+    this->changed.notify_all();
+}
+
+bool ImageWriter::flush()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while(!this->queue.empty() || this->writing)
+        this->changed.wait(guard);
+    bool succeeded = this->failures == 0;
+    this->failures = 0;
+    return succeeded;
+}
+
+unsigned int ImageWriter::getQueued()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    return this->queue.size() + (this->writing ? 1 : 0);
+}
+
+unsigned int ImageWriter::getMaxQueued()
+{
+    return this->maxQueued;
+}
+
+void ImageWriter::run()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while(true) {
+        while(this->queue.empty() && !this->stopping)
+            this->changed.wait(guard);
+        // the queue is drained before stopping
+        if(this->queue.empty())
+            break;
+
+        QueuedImage image;
+        image.first.swap(this->queue.front().first);
+        image.second.swap(this->queue.front().second);
+        this->queue.pop_front();
+        this->writing = true;
+        // a slot opened up for a blocked write()
+        this->changed.notify_all();
+
+        guard.unlock();
+        bool written = writeFile(image.first, image.second);
+        guard.lock();
+
+        if(!written)
+            this->failures++;
+        this->writing = false;
+        this->changed.notify_all();
+    }
+}
+
+bool ImageWriter::writeFile(const std::string &filename,
+        const std::vector<unsigned char> &data)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(file == NULL) {
+        std::cerr << "Could not write " << filename << std::endl;
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    // buffered data only reaches the disk, and errors only show up, here
+    if(fclose(file) != 0)
+        written = false;
+    if(!written)
+        std::cerr << "Could not write " << filename << std::endl;
+    return written;
+}
+
+}
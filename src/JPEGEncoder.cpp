@@ -0,0 +1,185 @@
+#include "JPEGEncoder.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <setjmp.h>
+#include <jpeglib.h>
+
+namespace pbnj {
+
+JPGSettings::JPGSettings() :
+    quality(100), subsampling(SUBSAMPLE_444), dct(DCT_ISLOW),
+    optimizeCoding(false)
+{
+}
+
+JPGSettings JPGSettings::fast()
+{
+    JPGSettings settings;
+    settings.quality = 85;
+    settings.subsampling = SUBSAMPLE_420;
+    settings.dct = DCT_IFAST;
+    return settings;
+}
+
+// bytes handed to libjpeg's destination manager at a time
+static const unsigned int OUTPUT_CHUNK = 64 * 1024;
+
+struct JPEGCompressor {
+    jpeg_compress_struct info;
+    jpeg_error_mgr errorManager;
+    jpeg_destination_mgr destination;
+    jmp_buf failure;
+    std::vector<unsigned char> *output;
+};
+
+// libjpeg's default error handler exits the program, jump back into
+// encode instead
+static void errorExit(j_common_ptr info)
+{
+    JPEGCompressor *compressor = (JPEGCompressor *)info->client_data;
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    std::cerr << "ERROR: could not encode JPG: " << message << std::endl;
+    longjmp(compressor->failure, 1);
+}
+
+// the destination manager writes straight into the output vector
+static void initDestination(j_compress_ptr info)
+{
+    JPEGCompressor *compressor = (JPEGCompressor *)info->client_data;
+    compressor->output->resize(OUTPUT_CHUNK);
+    info->dest->next_output_byte = compressor->output->data();
+    info->dest->free_in_buffer = OUTPUT_CHUNK;
+}
+
+static boolean emptyOutputBuffer(j_compress_ptr info)
+{
+    // libjpeg only calls this when the buffer is completely full
+    JPEGCompressor *compressor = (JPEGCompressor *)info->client_data;
+    std::vector<unsigned char> &output = *compressor->output;
+    size_t used = output.size();
+    output.resize(used + OUTPUT_CHUNK);
+    info->dest->next_output_byte = output.data() + used;
+    info->dest->free_in_buffer = OUTPUT_CHUNK;
+    return TRUE;
+}
+
+static void termDestination(j_compress_ptr info)
+{
+    JPEGCompressor *compressor = (JPEGCompressor *)info->client_data;
+    compressor->output->resize(compressor->output->size() -
+            info->dest->free_in_buffer);
+}
+
+JPEGEncoder::JPEGEncoder()
+{
+    this->compressor = new JPEGCompressor();
+    jpeg_compress_struct &info = this->compressor->info;
+    info.err = jpeg_std_error(&this->compressor->errorManager);
+    this->compressor->errorManager.error_exit = errorExit;
+    info.client_data = this->compressor;
+    jpeg_create_compress(&info);
+
+    jpeg_destination_mgr &destination = this->compressor->destination;
+    destination.init_destination = initDestination;
+    destination.empty_output_buffer = emptyOutputBuffer;
+    destination.term_destination = termDestination;
+    info.dest = &destination;
+}
+
+JPEGEncoder::~JPEGEncoder()
+{
+    jpeg_destroy_compress(&this->compressor->info);
+    delete this->compressor;
+}
+
+bool JPEGEncoder::encode(std::vector<unsigned char> &jpg,
+        const unsigned char *pixels, int width, int height,
+        unsigned int stride, PIXELFORMAT format,
+        const JPGSettings &settings)
+{
+    jpeg_compress_struct &info = this->compressor->info;
+    unsigned int inBytes = bytesPerPixel(format);
+    if(stride == 0)
+        stride = inBytes * width;
+    this->compressor->output = &jpg;
+
+    // libjpeg-turbo takes RGBA and BGRA rows as they are, plain libjpeg
+    // needs them converted to RGB one row at a time
+    bool convert = format != RGB;
+    J_COLOR_SPACE colorSpace = JCS_RGB;
+#ifdef JCS_EXTENSIONS
+    if(format == RGBA)
+        colorSpace = JCS_EXT_RGBA;
+    else if(format == BGRA)
+        colorSpace = JCS_EXT_BGRA;
+    convert = false;
+#endif
+    if(convert)
+        this->row.resize(3 * width);
+
+    if(setjmp(this->compressor->failure)) {
+        // a libjpeg error jumped back here, reset for the next image
+        jpeg_abort_compress(&info);
+        jpg.clear();
+        return false;
+    }
+
+    info.image_width = width;
+    info.image_height = height;
+    info.input_components = convert ? 3 : inBytes;
+    info.in_color_space = colorSpace;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, settings.quality, TRUE);
+    info.optimize_coding = settings.optimizeCoding;
+    if(settings.dct == DCT_IFAST)
+        info.dct_method = JDCT_IFAST;
+    else if(settings.dct == DCT_FLOAT)
+        info.dct_method = JDCT_FLOAT;
+    else
+        info.dct_method = JDCT_ISLOW;
+    // luma is the first component, its sampling factors set the chroma
+    // resolution relative to it
+    info.comp_info[0].h_samp_factor =
+        settings.subsampling == SUBSAMPLE_444 ? 1 : 2;
+    info.comp_info[0].v_samp_factor =
+        settings.subsampling == SUBSAMPLE_420 ? 2 : 1;
+    for(int c = 1; c < info.num_components; c++) {
+        info.comp_info[c].h_samp_factor = 1;
+        info.comp_info[c].v_samp_factor = 1;
+    }
+
+    jpeg_start_compress(&info, TRUE);
+    while(info.next_scanline < info.image_height) {
+        const unsigned char *rowIn = &pixels[info.next_scanline * stride];
+        JSAMPROW rowPointer = (JSAMPROW)rowIn;
+        if(convert) {
+            unsigned char *rowOut = this->row.data();
+            int r = format == BGRA ? 2 : 0, b = 2 - r;
+            for(int i = 0; i < width; i++) {
+                rowOut[3*i + 0] = rowIn[inBytes*i + r];
+                rowOut[3*i + 1] = rowIn[inBytes*i + 1];
+                rowOut[3*i + 2] = rowIn[inBytes*i + b];
+            }
+            rowPointer = rowOut;
+        }
+        jpeg_write_scanlines(&info, &rowPointer, 1);
+    }
+    jpeg_finish_compress(&info);
+    return true;
+}
+
+bool encodeJPG(std::vector<unsigned char> &jpg, const unsigned char *pixels,
+        int width, int height, unsigned int stride, PIXELFORMAT format,
+        const JPGSettings &settings)
+{
+    // setting up libjpeg's tables is only done once per thread
+    static thread_local JPEGEncoder encoder;
+    return encoder.encode(jpg, pixels, width, height, stride, format,
+            settings);
+}
+
+}
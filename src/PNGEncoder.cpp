@@ -0,0 +1,459 @@
+#include "PNGEncoder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "lodepng/lodepng.h"
+
+namespace pbnj {
+
+PNGSettings::PNGSettings() :
+    level(6), filter(FILTER_MINSUM), lazyMatching(true), windowSize(32768),
+    threads(0), autoConvert(true)
+{
+}
+
+PNGSettings PNGSettings::fast()
+{
+    PNGSettings settings;
+    settings.level = 1;
+    settings.filter = FILTER_UP;
+    settings.lazyMatching = false;
+    settings.autoConvert = false;
+    return settings;
+}
+
+PNGSettings PNGSettings::best()
+{
+    PNGSettings settings;
+    settings.level = 9;
+    settings.filter = FILTER_ENTROPY;
+    return settings;
+}
+
+// deflate needs the previous band's data as a dictionary so matches can
+// reach across band boundaries, it only ever looks back this far
+static const unsigned int DICTIONARY_SIZE = 32768;
+// bands smaller than this compress noticeably worse
+static const unsigned long int MIN_BAND_BYTES = 128 * 1024;
+
+/*
+ * Deflates one band as raw deflate data. Every band but the last ends in a
+ * sync flush, which leaves the output byte aligned and not final, so the
+ * bands can simply be concatenated.
+ */
+static int deflateBand(const unsigned char *in, unsigned long int size,
+        const unsigned char *dictionary, unsigned int dictionarySize,
+        bool last, const PNGSettings &settings,
+        std::vector<unsigned char> &out)
+{
+    int level = std::min(std::max(settings.level, 1), 9);
+    // zlib only matches greedily at levels 1 to 3, setting max_lazy to 0
+    // at higher levels stops it from finding any matches at all
+    if(!settings.lazyMatching)
+        level = std::min(level, 3);
+    int windowBits = 9;
+    while(windowBits < 15 && (1u << windowBits) < settings.windowSize)
+        windowBits++;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // negative window bits for raw deflate, the zlib wrapper is added once
+    // around all the bands
+    int error = deflateInit2(&stream, level, Z_DEFLATED, -windowBits, 8,
+            Z_DEFAULT_STRATEGY);
+    if(error != Z_OK)
+        return error;
+    if(dictionarySize > 0)
+        deflateSetDictionary(&stream, dictionary, dictionarySize);
+
+    out.resize(deflateBound(&stream, size) + 16);
+    stream.next_in = (Bytef *)in;
+    stream.avail_in = size;
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    error = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    out.resize(out.size() - stream.avail_out);
+    deflateEnd(&stream);
+    if(last)
+        return error == Z_STREAM_END ? Z_OK : Z_BUF_ERROR;
+    return error;
+}
+
+/*
+ * Deflates in as raw deflate data split into bands that are compressed in
+ * parallel, appended to out. history is up to DICTIONARY_SIZE bytes that
+ * came right before in, so matches can reach back into them. Unless last
+ * is set the data ends in a sync flush, so more can be appended later.
+ * checksum is updated with the adler32 of in.
+ */
+static int deflateParallel(const unsigned char *in, unsigned long int inSize,
+        const unsigned char *history, unsigned int historySize, bool last,
+        const PNGSettings &settings, std::vector<unsigned char> &out,
+        uLong &checksum)
+{
+    unsigned long int numBands = settings.threads;
+    if(numBands == 0)
+        numBands = getNumThreads();
+    numBands = std::max(std::min(numBands,
+                (unsigned long int)(inSize / MIN_BAND_BYTES)),
+            (unsigned long int)1);
+    unsigned long int bandSize = (inSize + numBands - 1) / numBands;
+
+    std::vector<std::vector<unsigned char> > bands(numBands);
+    std::vector<uLong> checksums(numBands);
+    std::vector<int> errors(numBands, Z_OK);
+    parallelFor(numBands, [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        for(unsigned long int b = start; b < end; b++) {
+            unsigned long int offset = b * bandSize;
+            unsigned long int size = std::min(bandSize, inSize - offset);
+            const unsigned char *dictionary = history;
+            unsigned int dictionarySize = historySize;
+            if(b > 0) {
+                dictionarySize = std::min(offset,
+                        (unsigned long int)DICTIONARY_SIZE);
+                dictionary = &in[offset - dictionarySize];
+            }
+            errors[b] = deflateBand(in + offset, size, dictionary,
+                    dictionarySize, last && b == numBands - 1, settings,
+                    bands[b]);
+            checksums[b] = adler32(adler32(0, NULL, 0), in + offset, size);
+        }
+    });
+
+    for(unsigned long int b = 0; b < numBands; b++) {
+        if(errors[b] != Z_OK)
+            return errors[b];
+        unsigned long int size = std::min(bandSize, inSize - b * bandSize);
+        if(size > 0)
+            checksum = adler32_combine(checksum, checksums[b], size);
+        out.insert(out.end(), bands[b].begin(), bands[b].end());
+    }
+    return Z_OK;
+}
+
+// zlib header for a 32K window with the level as a hint
+static void appendZlibHeader(std::vector<unsigned char> &out,
+        const PNGSettings &settings)
+{
+    int level = std::min(std::max(settings.level, 1), 9);
+    unsigned int flevel = level == 1 ? 0 : (level < 6 ? 1 :
+            (level == 6 ? 2 : 3));
+    unsigned int header = (0x78 << 8) | (flevel << 6);
+    header += 31 - header % 31;
+    out.push_back(header >> 8);
+    out.push_back(header & 0xff);
+}
+
+static void appendBigEndian(std::vector<unsigned char> &out,
+        unsigned long int value)
+{
+    out.push_back((value >> 24) & 0xff);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+/*
+ * lodepng hands the filtered rows to this instead of its own deflate.
+ * Returns the zlib stream in memory allocated with malloc, which lodepng
+ * frees.
+ */
+static unsigned parallelZlib(unsigned char **out, size_t *outSize,
+        const unsigned char *in, size_t inSize,
+        const LodePNGCompressSettings *lodeSettings)
+{
+    const PNGSettings &settings =
+        *(const PNGSettings *)lodeSettings->custom_context;
+
+    std::vector<unsigned char> zlib;
+    appendZlibHeader(zlib, settings);
+    uLong checksum = adler32(0, NULL, 0);
+    if(deflateParallel(in, inSize, NULL, 0, true, settings, zlib,
+                checksum) != Z_OK)
+        return 111;
+    appendBigEndian(zlib, checksum);
+
+    unsigned char *stream = (unsigned char *)malloc(zlib.size());
+    if(stream == NULL)
+        return 83;
+    memcpy(stream, zlib.data(), zlib.size());
+    *out = stream;
+    *outSize = zlib.size();
+    return 0;
+}
+
+unsigned int encodePNG(std::vector<unsigned char> &png,
+        const unsigned char *rgba, int width, int height,
+        const PNGSettings &settings)
+{
+    lodepng::State state;
+    state.encoder.auto_convert = settings.autoConvert;
+    state.encoder.filter_palette_zero = 0;
+    state.encoder.zlibsettings.custom_zlib = parallelZlib;
+    state.encoder.zlibsettings.custom_context = &settings;
+
+    std::vector<unsigned char> filters;
+    if(settings.filter == FILTER_NONE)
+        state.encoder.filter_strategy = LFS_ZERO;
+    else if(settings.filter == FILTER_UP) {
+        // PNG filter type 2 on every row
+        filters.assign(height, 2);
+        state.encoder.filter_strategy = LFS_PREDEFINED;
+        state.encoder.predefined_filters = filters.data();
+    }
+    else if(settings.filter == FILTER_ENTROPY)
+        state.encoder.filter_strategy = LFS_ENTROPY;
+    else
+        state.encoder.filter_strategy = LFS_MINSUM;
+
+    png.clear();
+    return lodepng::encode(png, rgba, width, height, state);
+}
+
+static inline unsigned char paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if(pa <= pb && pa <= pc)
+        return a;
+    if(pb <= pc)
+        return b;
+    return c;
+}
+
+/*
+ * Filters one row with PNG filter type 0 to 4 into out, previous is the
+ * unfiltered row above it (zeros above the first row).
+ */
+static void filterRow(unsigned char *out, const unsigned char *row,
+        const unsigned char *previous, unsigned int rowBytes,
+        unsigned int bpp, int type)
+{
+    unsigned int i;
+    if(type == 0) {
+        memcpy(out, row, rowBytes);
+    }
+    else if(type == 1) {
+        for(i = 0; i < bpp; i++)
+            out[i] = row[i];
+        for(i = bpp; i < rowBytes; i++)
+            out[i] = row[i] - row[i - bpp];
+    }
+    else if(type == 2) {
+        for(i = 0; i < rowBytes; i++)
+            out[i] = row[i] - previous[i];
+    }
+    else if(type == 3) {
+        for(i = 0; i < bpp; i++)
+            out[i] = row[i] - (previous[i] >> 1);
+        for(i = bpp; i < rowBytes; i++)
+            out[i] = row[i] - ((row[i - bpp] + previous[i]) >> 1);
+    }
+    else {
+        for(i = 0; i < bpp; i++)
+            out[i] = row[i] - previous[i];
+        for(i = bpp; i < rowBytes; i++)
+            out[i] = row[i] - paethPredictor(row[i - bpp], previous[i],
+                    previous[i - bpp]);
+    }
+}
+
+// how well a filtered row should compress, lower is better
+static double filterCost(const unsigned char *data, unsigned int size,
+        PNGFILTER filter)
+{
+    if(filter == FILTER_ENTROPY) {
+        unsigned int counts[256] = {0};
+        for(unsigned int i = 0; i < size; i++)
+            counts[data[i]]++;
+        double bits = 0.0;
+        for(unsigned int i = 0; i < 256; i++)
+            if(counts[i] > 0)
+                bits += counts[i] * std::log2((double)size / counts[i]);
+        return bits;
+    }
+    unsigned long int sum = 0;
+    for(unsigned int i = 0; i < size; i++)
+        sum += abs((signed char)data[i]);
+    return sum;
+}
+
+PNGStreamEncoder::PNGStreamEncoder() :
+    width(0), height(0), rowsEncoded(0), channels(4), checksum(0),
+    started(false)
+{
+}
+
+void PNGStreamEncoder::appendChunk(std::vector<unsigned char> &png,
+        const char *type, const unsigned char *data, unsigned long int size)
+{
+    appendBigEndian(png, size);
+    unsigned long int start = png.size();
+    png.insert(png.end(), type, type + 4);
+    if(size > 0)
+        png.insert(png.end(), data, data + size);
+    appendBigEndian(png, crc32(crc32(0, NULL, 0), &png[start], size + 4));
+}
+
+bool PNGStreamEncoder::begin(std::vector<unsigned char> &png, int width,
+        int height, PIXELFORMAT format, const PNGSettings &settings)
+{
+    png.clear();
+    if(width <= 0 || height <= 0 || format == BGRA) {
+        std::cerr << "ERROR: can only stream RGBA or RGB PNGs of at least ";
+        std::cerr << "one pixel" << std::endl;
+        return false;
+    }
+    this->settings = settings;
+    this->width = width;
+    this->height = height;
+    this->rowsEncoded = 0;
+    this->channels = bytesPerPixel(format);
+    this->previousRow.assign(this->channels * width, 0);
+    this->history.clear();
+    this->checksum = adler32(0, NULL, 0);
+    this->started = true;
+
+    static const unsigned char signature[8] =
+        {137, 80, 78, 71, 13, 10, 26, 10};
+    png.insert(png.end(), signature, signature + 8);
+    std::vector<unsigned char> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    // 8 bits, RGBA or RGB, deflate, adaptive filtering, not interlaced
+    header.push_back(8);
+    header.push_back(this->channels == 4 ? 6 : 2);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    this->appendChunk(png, "IHDR", header.data(), header.size());
+    return true;
+}
+
+bool PNGStreamEncoder::encodeRows(std::vector<unsigned char> &png,
+        const unsigned char *pixels, int rows, unsigned int stride)
+{
+    png.clear();
+    if(!this->started || rows <= 0 ||
+            this->rowsEncoded + rows > this->height) {
+        std::cerr << "ERROR: rows don't fit in the PNG being streamed";
+        std::cerr << std::endl;
+        return false;
+    }
+    unsigned int rowBytes = this->channels * this->width;
+    if(stride == 0)
+        stride = rowBytes;
+
+    // every row only needs itself and the row above, so the band is
+    // filtered in parallel
+    PNGFILTER filter = this->settings.filter;
+    unsigned int bpp = this->channels;
+    const unsigned char *firstPrevious = this->previousRow.data();
+    this->filtered.resize((unsigned long int)rows * (rowBytes + 1));
+    unsigned char *filtered = this->filtered.data();
+    parallelFor(rows, [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        std::vector<unsigned char> candidate, best;
+        if(filter == FILTER_MINSUM || filter == FILTER_ENTROPY) {
+            candidate.resize(rowBytes);
+            best.resize(rowBytes);
+        }
+        for(unsigned long int r = start; r < end; r++) {
+            const unsigned char *row = pixels + r * stride;
+            const unsigned char *previous = r == 0 ? firstPrevious :
+                row - stride;
+            unsigned char *out = filtered + r * (rowBytes + 1);
+            if(filter == FILTER_NONE || filter == FILTER_UP) {
+                out[0] = filter == FILTER_NONE ? 0 : 2;
+                filterRow(out + 1, row, previous, rowBytes, bpp, out[0]);
+                continue;
+            }
+            double bestCost = 0.0;
+            for(int type = 0; type < 5; type++) {
+                filterRow(candidate.data(), row, previous, rowBytes, bpp,
+                        type);
+                double cost = filterCost(candidate.data(), rowBytes,
+                        filter);
+                if(type == 0 || cost < bestCost) {
+                    bestCost = cost;
+                    out[0] = type;
+                    best.swap(candidate);
+                }
+            }
+            memcpy(out + 1, best.data(), rowBytes);
+        }
+    }, std::max(65536u / (rowBytes + 1), 1u));
+
+    const unsigned char *lastRow = pixels + (unsigned long int)(rows - 1) *
+        stride;
+    this->previousRow.assign(lastRow, lastRow + rowBytes);
+
+    this->compressed.clear();
+    if(this->rowsEncoded == 0)
+        appendZlibHeader(this->compressed, this->settings);
+    bool last = this->rowsEncoded + rows == this->height;
+    uLong checksum = this->checksum;
+    int error = deflateParallel(this->filtered.data(),
+            this->filtered.size(), this->history.data(),
+            this->history.size(), last, this->settings, this->compressed,
+            checksum);
+    if(error != Z_OK) {
+        std::cerr << "ERROR: could not deflate PNG rows, zlib error ";
+        std::cerr << error << std::endl;
+        this->started = false;
+        return false;
+    }
+    this->checksum = checksum;
+    if(last)
+        appendBigEndian(this->compressed, this->checksum);
+
+    // the next band's dictionary is the end of everything filtered so far
+    if(this->filtered.size() >= DICTIONARY_SIZE) {
+        this->history.assign(this->filtered.end() - DICTIONARY_SIZE,
+                this->filtered.end());
+    }
+    else {
+        this->history.insert(this->history.end(), this->filtered.begin(),
+                this->filtered.end());
+        if(this->history.size() > DICTIONARY_SIZE)
+            this->history.erase(this->history.begin(),
+                    this->history.end() - DICTIONARY_SIZE);
+    }
+    this->rowsEncoded += rows;
+
+    // chunks are limited to 2^31 - 1 bytes
+    const unsigned long int maxChunk = 1ul << 30;
+    for(unsigned long int offset = 0; offset < this->compressed.size();
+            offset += maxChunk)
+        this->appendChunk(png, "IDAT", &this->compressed[offset],
+                std::min(maxChunk, this->compressed.size() - offset));
+    return true;
+}
+
+bool PNGStreamEncoder::end(std::vector<unsigned char> &png)
+{
+    png.clear();
+    if(!this->started || this->rowsEncoded != this->height) {
+        std::cerr << "ERROR: PNG stream ended before every row was ";
+        std::cerr << "encoded" << std::endl;
+        this->started = false;
+        return false;
+    }
+    this->appendChunk(png, "IEND", NULL, 0);
+    this->started = false;
+    this->filtered.clear();
+    this->filtered.shrink_to_fit();
+    this->compressed.clear();
+    this->compressed.shrink_to_fit();
+    return true;
+}
+
+}
@@ -0,0 +1,44 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace pbnj {
+
+unsigned int getNumThreads()
+{
+    // hardware_concurrency may return 0 if it can't tell
+    return std::max(std::thread::hardware_concurrency(), (unsigned int) 1);
+}
+
+void parallelFor(unsigned long int count,
+        std::function<void(unsigned long int, unsigned long int,
+            unsigned int)> func,
+        unsigned long int minChunk)
+{
+    if(count == 0)
+        return;
+
+    minChunk = std::max(minChunk, (unsigned long int) 1);
+    unsigned long int numChunks = std::min((unsigned long int)getNumThreads(),
+            (count + minChunk - 1) / minChunk);
+    unsigned long int chunkSize = (count + numChunks - 1) / numChunks;
+    // rounding up the chunk size can leave fewer chunks than threads
+    numChunks = (count + chunkSize - 1) / chunkSize;
+
+    // the calling thread takes the last chunk instead of sitting idle
+    std::vector<std::thread> workers;
+    workers.reserve(numChunks - 1);
+    for(unsigned int t = 0; t < numChunks - 1; t++) {
+        unsigned long int start = t * chunkSize;
+        unsigned long int end = std::min(start + chunkSize, count);
+        workers.push_back(std::thread(func, start, end, t));
+    }
+    func((numChunks - 1) * chunkSize, count, numChunks - 1);
+
+    for(unsigned int t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+}
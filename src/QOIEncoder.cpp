@@ -0,0 +1,272 @@
+#include "QOIEncoder.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace pbnj {
+
+static const unsigned char QOI_OP_INDEX = 0x00;
+static const unsigned char QOI_OP_DIFF = 0x40;
+static const unsigned char QOI_OP_LUMA = 0x80;
+static const unsigned char QOI_OP_RUN = 0xc0;
+static const unsigned char QOI_OP_RGB = 0xfe;
+static const unsigned char QOI_OP_RGBA = 0xff;
+static const unsigned char QOI_MASK = 0xc0;
+
+static const unsigned int QOI_HEADER_SIZE = 14;
+static const unsigned char QOI_END[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+// the format's own limit, keeps width * height * 5 in range
+static const unsigned long int QOI_MAX_PIXELS = 400000000;
+
+struct QOIPixel {
+    unsigned char r, g, b, a;
+};
+
+static inline bool samePixel(const QOIPixel &p, const QOIPixel &q)
+{
+    return p.r == q.r && p.g == q.g && p.b == q.b && p.a == q.a;
+}
+
+static inline unsigned int hashPixel(const QOIPixel &p)
+{
+    return (p.r*3 + p.g*5 + p.b*7 + p.a*11) % 64;
+}
+
+static void writeBigEndian(unsigned char *out, unsigned int value)
+{
+    out[0] = (value >> 24) & 0xff;
+    out[1] = (value >> 16) & 0xff;
+    out[2] = (value >> 8) & 0xff;
+    out[3] = value & 0xff;
+}
+
+static unsigned int readBigEndian(const unsigned char *in)
+{
+    return ((unsigned int)in[0] << 24) | ((unsigned int)in[1] << 16) |
+        ((unsigned int)in[2] << 8) | in[3];
+}
+
+/*
+ * The chunk stream for one image, R G B A are the byte offsets of each
+ * channel within a pixel (A < 0 means opaque). Writes at most 5 bytes per
+ * pixel and returns the end of what was written.
+ */
+template<int R, int G, int B, int A, unsigned int BPP>
+static unsigned char *encodeChunks(unsigned char *out,
+        const unsigned char *pixels, int width, int height,
+        unsigned int stride)
+{
+    QOIPixel index[64];
+    memset(index, 0, sizeof(index));
+    QOIPixel previous = {0, 0, 0, 255};
+    unsigned int run = 0;
+
+    for(int j = 0; j < height; j++) {
+        const unsigned char *row = pixels + (unsigned long int)j * stride;
+        for(int i = 0; i < width; i++) {
+            const unsigned char *p = row + i * BPP;
+            QOIPixel pixel = {p[R], p[G], p[B],
+                (unsigned char)(A < 0 ? 255 : p[A < 0 ? 0 : A])};
+
+            if(samePixel(pixel, previous)) {
+                run++;
+                if(run == 62) {
+                    *out++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if(run > 0) {
+                *out++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            unsigned int hash = hashPixel(pixel);
+            if(samePixel(index[hash], pixel)) {
+                *out++ = QOI_OP_INDEX | hash;
+            }
+            else {
+                index[hash] = pixel;
+                if(pixel.a == previous.a) {
+                    // differences wrap around, as in the decoder
+                    signed char dr = (signed char)(pixel.r - previous.r);
+                    signed char dg = (signed char)(pixel.g - previous.g);
+                    signed char db = (signed char)(pixel.b - previous.b);
+                    int drg = dr - dg;
+                    int dbg = db - dg;
+                    if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+                            db >= -2 && db <= 1) {
+                        *out++ = QOI_OP_DIFF | ((dr + 2) << 4) |
+                            ((dg + 2) << 2) | (db + 2);
+                    }
+                    else if(dg >= -32 && dg <= 31 && drg >= -8 &&
+                            drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        *out++ = QOI_OP_LUMA | (dg + 32);
+                        *out++ = ((drg + 8) << 4) | (dbg + 8);
+                    }
+                    else {
+                        *out++ = QOI_OP_RGB;
+                        *out++ = pixel.r;
+                        *out++ = pixel.g;
+                        *out++ = pixel.b;
+                    }
+                }
+                else {
+                    *out++ = QOI_OP_RGBA;
+                    *out++ = pixel.r;
+                    *out++ = pixel.g;
+                    *out++ = pixel.b;
+                    *out++ = pixel.a;
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if(run > 0)
+        *out++ = QOI_OP_RUN | (run - 1);
+    return out;
+}
+
+bool encodeQOI(std::vector<unsigned char> &qoi,
+        const unsigned char *pixels, int width, int height,
+        unsigned int stride, PIXELFORMAT format)
+{
+    qoi.clear();
+    if(width <= 0 || height <= 0 ||
+            (unsigned long int)width * height > QOI_MAX_PIXELS) {
+        std::cerr << "ERROR: image size not supported by QOI" << std::endl;
+        return false;
+    }
+    if(stride == 0)
+        stride = bytesPerPixel(format) * width;
+
+    // worst case, every pixel changes alpha
+    unsigned long int pixelCount = (unsigned long int)width * height;
+    qoi.resize(QOI_HEADER_SIZE + pixelCount * 5 + sizeof(QOI_END));
+    unsigned char *out = qoi.data();
+    memcpy(out, "qoif", 4);
+    writeBigEndian(out + 4, width);
+    writeBigEndian(out + 8, height);
+    out[12] = format == RGB ? 3 : 4;
+    // sRGB color with linear alpha
+    out[13] = 0;
+    out += QOI_HEADER_SIZE;
+
+    if(format == RGB)
+        out = encodeChunks<0, 1, 2, -1, 3>(out, pixels, width, height,
+                stride);
+    else if(format == BGRA)
+        out = encodeChunks<2, 1, 0, 3, 4>(out, pixels, width, height,
+                stride);
+    else
+        out = encodeChunks<0, 1, 2, 3, 4>(out, pixels, width, height,
+                stride);
+
+    memcpy(out, QOI_END, sizeof(QOI_END));
+    out += sizeof(QOI_END);
+    qoi.resize(out - qoi.data());
+    return true;
+}
+
+/*
+ * Fills width * height pixels from the chunks in [p, end), returns false
+ * if the chunks run out first.
+ */
+static bool decodeChunks(const unsigned char *qoi, unsigned long int p,
+        unsigned long int end, unsigned char *data, unsigned int width,
+        unsigned int height, unsigned int stride, unsigned int channels)
+{
+    QOIPixel index[64];
+    memset(index, 0, sizeof(index));
+    QOIPixel pixel = {0, 0, 0, 255};
+    unsigned int run = 0;
+
+    for(unsigned int j = 0; j < height; j++) {
+        unsigned char *row = data + (unsigned long int)j * stride;
+        for(unsigned int i = 0; i < width; i++) {
+            if(run > 0) {
+                run--;
+            }
+            else {
+                if(p >= end)
+                    return false;
+                unsigned char b1 = qoi[p++];
+                if(b1 == QOI_OP_RGB) {
+                    if(p + 3 > end)
+                        return false;
+                    pixel.r = qoi[p++];
+                    pixel.g = qoi[p++];
+                    pixel.b = qoi[p++];
+                }
+                else if(b1 == QOI_OP_RGBA) {
+                    if(p + 4 > end)
+                        return false;
+                    pixel.r = qoi[p++];
+                    pixel.g = qoi[p++];
+                    pixel.b = qoi[p++];
+                    pixel.a = qoi[p++];
+                }
+                else if((b1 & QOI_MASK) == QOI_OP_INDEX) {
+                    pixel = index[b1];
+                }
+                else if((b1 & QOI_MASK) == QOI_OP_DIFF) {
+                    pixel.r += ((b1 >> 4) & 0x03) - 2;
+                    pixel.g += ((b1 >> 2) & 0x03) - 2;
+                    pixel.b += (b1 & 0x03) - 2;
+                }
+                else if((b1 & QOI_MASK) == QOI_OP_LUMA) {
+                    if(p >= end)
+                        return false;
+                    unsigned char b2 = qoi[p++];
+                    int dg = (b1 & 0x3f) - 32;
+                    pixel.r += dg - 8 + ((b2 >> 4) & 0x0f);
+                    pixel.g += dg;
+                    pixel.b += dg - 8 + (b2 & 0x0f);
+                }
+                else {
+                    run = b1 & 0x3f;
+                }
+                index[hashPixel(pixel)] = pixel;
+            }
+
+            unsigned char *out = row + i * channels;
+            out[0] = pixel.r;
+            out[1] = pixel.g;
+            out[2] = pixel.b;
+            if(channels == 4)
+                out[3] = pixel.a;
+        }
+    }
+    return true;
+}
+
+bool decodeQOI(const unsigned char *qoi, unsigned long int size,
+        Image &image)
+{
+    if(size < QOI_HEADER_SIZE + sizeof(QOI_END) ||
+            memcmp(qoi, "qoif", 4) != 0) {
+        std::cerr << "ERROR: not a QOI image" << std::endl;
+        return false;
+    }
+    unsigned int width = readBigEndian(qoi + 4);
+    unsigned int height = readBigEndian(qoi + 8);
+    unsigned int channels = qoi[12];
+    if(width == 0 || height == 0 ||
+            (unsigned long int)width * height > QOI_MAX_PIXELS ||
+            (channels != 3 && channels != 4) || qoi[13] > 1) {
+        std::cerr << "ERROR: invalid QOI header" << std::endl;
+        return false;
+    }
+
+    image.setFormat(channels == 3 ? RGB : RGBA);
+    image.resize(width, height);
+    if(!decodeChunks(qoi, QOI_HEADER_SIZE, size - sizeof(QOI_END),
+                image.getData(), width, height, image.getStride(),
+                channels)) {
+        std::cerr << "ERROR: QOI image is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
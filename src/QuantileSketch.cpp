@@ -0,0 +1,141 @@
+#include "QuantileSketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace pbnj {
+
+// 32 KB of counts, fine enough for percentiles of any range of data
+static const int64_t NUM_BUCKETS = 4096;
+
+QuantileSketch::QuantileSketch() :
+    counts(NUM_BUCKETS, 0)
+{
+    this->clear();
+}
+
+void QuantileSketch::clear()
+{
+    std::fill(this->counts.begin(), this->counts.end(), 0);
+    this->base = 0;
+    this->exponent = 0;
+    this->count = 0;
+    this->minVal = std::numeric_limits<float>::max();
+    this->maxVal = std::numeric_limits<float>::lowest();
+}
+
+double QuantileSketch::index(float value, int exponent)
+{
+    // exact, the width is a power of two
+    return std::floor(std::ldexp((double) value, -exponent));
+}
+
+/*
+ * Widens the buckets from 2^exponent until [low, high] fits in them and
+ * moves the counts over. The values are centered in the buckets so the
+ * next few values outside them don't need another move.
+ */
+void QuantileSketch::fit(float low, float high, int exponent)
+{
+    while(this->index(high, exponent) - this->index(low, exponent) >=
+            NUM_BUCKETS)
+        exponent++;
+    int64_t used = (int64_t) (this->index(high, exponent) -
+            this->index(low, exponent)) + 1;
+
+    std::vector<uint64_t> old(NUM_BUCKETS, 0);
+    old.swap(this->counts);
+    int64_t oldBase = this->base;
+    int oldExponent = this->exponent;
+    this->base = (int64_t) this->index(low, exponent) -
+        (NUM_BUCKETS - used) / 2;
+    this->exponent = exponent;
+    this->addBuckets(old, oldBase, oldExponent);
+}
+
+void QuantileSketch::addBuckets(const std::vector<uint64_t> &other,
+        int64_t otherBase, int otherExponent)
+{
+    // the buckets are at least as wide as the other ones and cover all of
+    // their values, so every other bucket falls inside exactly one of them
+    int shift = this->exponent - otherExponent;
+    for(int64_t i = 0; i < NUM_BUCKETS; i++) {
+        if(other[i] == 0)
+            continue;
+        int64_t b = (int64_t) std::floor(std::ldexp((double) (otherBase + i),
+                    -shift));
+        this->counts[b - this->base] += other[i];
+    }
+}
+
+void QuantileSketch::add(float value)
+{
+    // NaNs have no place in an ordering, infinities none in a bucket
+    if(!std::isfinite(value))
+        return;
+    if(this->count == 0) {
+        // start out finer than the float's own precision
+        this->exponent = value == 0 ? -149 : std::ilogb(value) - 30;
+        this->base = (int64_t) this->index(value, this->exponent) -
+            NUM_BUCKETS / 2;
+    }
+    double bucket = this->index(value, this->exponent) - this->base;
+    if(bucket < 0 || bucket >= NUM_BUCKETS) {
+        this->fit(std::min(this->minVal, value),
+                std::max(this->maxVal, value), this->exponent);
+        bucket = this->index(value, this->exponent) - this->base;
+    }
+    this->counts[(int64_t) bucket]++;
+    this->count++;
+    this->minVal = std::min(this->minVal, value);
+    this->maxVal = std::max(this->maxVal, value);
+}
+
+void QuantileSketch::merge(const QuantileSketch &other)
+{
+    if(other.count == 0)
+        return;
+    if(this->count == 0) {
+        *this = other;
+        return;
+    }
+    this->fit(std::min(this->minVal, other.minVal),
+            std::max(this->maxVal, other.maxVal),
+            std::max(this->exponent, other.exponent));
+    this->addBuckets(other.counts, other.base, other.exponent);
+    this->count += other.count;
+    this->minVal = std::min(this->minVal, other.minVal);
+    this->maxVal = std::max(this->maxVal, other.maxVal);
+}
+
+float QuantileSketch::quantile(float q)
+{
+    if(this->count == 0)
+        return 0.0;
+    if(q <= 0.0)
+        return this->minVal;
+    if(q >= 1.0)
+        return this->maxVal;
+
+    // rank of the requested value, then find the bucket that holds it
+    uint64_t rank = q * (this->count - 1);
+    uint64_t cumulative = 0;
+    for(int64_t b = 0; b < NUM_BUCKETS; b++) {
+        cumulative += this->counts[b];
+        if(cumulative > rank) {
+            // the bucket middle can be past the extremes of the data
+            float value = std::ldexp((double) (this->base + b) + 0.5,
+                    this->exponent);
+            return std::max(this->minVal, std::min(this->maxVal, value));
+        }
+    }
+    return this->maxVal;
+}
+
+unsigned long int QuantileSketch::getCount()
+{
+    return this->count;
+}
+
+}
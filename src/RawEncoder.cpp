@@ -0,0 +1,99 @@
+#include "RawEncoder.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace pbnj {
+
+static const unsigned char RAW_VERSION = 1;
+
+static void writeLittleEndian(unsigned char *out, unsigned int value)
+{
+    out[0] = value & 0xff;
+    out[1] = (value >> 8) & 0xff;
+    out[2] = (value >> 16) & 0xff;
+    out[3] = (value >> 24) & 0xff;
+}
+
+static unsigned int readLittleEndian(const unsigned char *in)
+{
+    return in[0] | ((unsigned int)in[1] << 8) |
+        ((unsigned int)in[2] << 16) | ((unsigned int)in[3] << 24);
+}
+
+bool encodeRaw(std::vector<unsigned char> &raw,
+        const unsigned char *pixels, int width, int height,
+        unsigned int stride, PIXELFORMAT format)
+{
+    raw.clear();
+    if(width <= 0 || height <= 0) {
+        std::cerr << "ERROR: can't store an empty raw image" << std::endl;
+        return false;
+    }
+    unsigned int rowBytes = bytesPerPixel(format) * width;
+    if(stride == 0)
+        stride = rowBytes;
+
+    raw.resize(RAW_HEADER_SIZE + (unsigned long int)rowBytes * height);
+    unsigned char *out = raw.data();
+    memcpy(out, "PBNJ", 4);
+    out[4] = RAW_VERSION;
+    out[5] = (unsigned char)format;
+    out[6] = 0;
+    out[7] = 0;
+    writeLittleEndian(out + 8, width);
+    writeLittleEndian(out + 12, height);
+    out += RAW_HEADER_SIZE;
+
+    if(stride == rowBytes) {
+        memcpy(out, pixels, (unsigned long int)rowBytes * height);
+    }
+    else {
+        for(int j = 0; j < height; j++)
+            memcpy(out + (unsigned long int)j * rowBytes,
+                    pixels + (unsigned long int)j * stride, rowBytes);
+    }
+    return true;
+}
+
+bool decodeRaw(const unsigned char *raw, unsigned long int size,
+        Image &image)
+{
+    if(size < RAW_HEADER_SIZE || memcmp(raw, "PBNJ", 4) != 0) {
+        std::cerr << "ERROR: not a raw PBNJ image" << std::endl;
+        return false;
+    }
+    if(raw[4] != RAW_VERSION || raw[5] > BGRA) {
+        std::cerr << "ERROR: unsupported raw image version or format";
+        std::cerr << std::endl;
+        return false;
+    }
+    PIXELFORMAT format = (PIXELFORMAT)raw[5];
+    unsigned int width = readLittleEndian(raw + 8);
+    unsigned int height = readLittleEndian(raw + 12);
+    unsigned long int rowBytes = (unsigned long int)bytesPerPixel(format) *
+        width;
+    if(width == 0 || height == 0 || width > 0x7fffffff ||
+            height > 0x7fffffff ||
+            (size - RAW_HEADER_SIZE) / rowBytes < height) {
+        std::cerr << "ERROR: raw image is truncated" << std::endl;
+        return false;
+    }
+
+    image.setFormat(format);
+    image.resize(width, height);
+    const unsigned char *in = raw + RAW_HEADER_SIZE;
+    unsigned char *data = image.getData();
+    unsigned int stride = image.getStride();
+    if(stride == rowBytes) {
+        memcpy(data, in, rowBytes * height);
+    }
+    else {
+        for(unsigned int j = 0; j < height; j++)
+            memcpy(data + (unsigned long int)j * stride, in + j * rowBytes,
+                    rowBytes);
+    }
+    return true;
+}
+
+}
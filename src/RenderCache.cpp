@@ -0,0 +1,157 @@
+#include "RenderCache.h"
+#include "ImageWriter.h"
+#include "pbnj.h"
+
+#include <iostream>
+
+#include <stdio.h>
+#include <unistd.h>
+
+namespace pbnj {
+
+RenderCache::RenderCache(unsigned long int byteBudget,
+        std::string directory) :
+    byteBudget(byteBudget), bytes(0), directory(directory), hits(0),
+    diskHits(0), misses(0), insertions(0), evictions(0)
+{
+    if(!this->directory.empty() && this->directory.back() != '/')
+        this->directory += '/';
+}
+
+bool RenderCache::find(unsigned long int key,
+        std::vector<unsigned char> &encoded)
+{
+    CachedImage image;
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        std::unordered_map<unsigned long int, LRUList::iterator>::iterator
+            found = this->index.find(key);
+        if(found != this->index.end()) {
+            this->entries.splice(this->entries.begin(), this->entries,
+                    found->second);
+            image = found->second->second;
+            this->hits++;
+        }
+        else if(this->directory.empty()) {
+            this->misses++;
+            return false;
+        }
+    }
+    // copy outside the lock, the image stays alive even if it is evicted
+    // in the meantime
+    if(image) {
+        encoded.assign(image->begin(), image->end());
+        return true;
+    }
+
+    std::vector<unsigned char> stored;
+    FILE *file = fopen(this->filename(key).c_str(), "rb");
+    if(file != NULL) {
+        if(fseek(file, 0, SEEK_END) == 0) {
+            long int size = ftell(file);
+            rewind(file);
+            if(size > 0) {
+                stored.resize(size);
+                if(fread(stored.data(), 1, size, file) != (size_t)size)
+                    stored.clear();
+            }
+        }
+        fclose(file);
+    }
+
+    std::unique_lock<std::mutex> guard(this->lock);
+    if(stored.empty()) {
+        this->misses++;
+        return false;
+    }
+    this->hits++;
+    this->diskHits++;
+    encoded = stored;
+    this->keep(key, CachedImage(
+                new std::vector<unsigned char>(std::move(stored))));
+    return true;
+}
+
+void RenderCache::insert(unsigned long int key,
+        const std::vector<unsigned char> &encoded)
+{
+    if(encoded.empty())
+        return;
+    CachedImage image(new std::vector<unsigned char>(encoded));
+    if(!this->directory.empty()) {
+        // written under a temporary name and renamed, so other processes
+        // never read half a file
+        std::string target = this->filename(key);
+        std::string temporary = target + "." + std::to_string(getpid()) +
+            "." + std::to_string(createID());
+        if(ImageWriter::writeFile(temporary, *image)) {
+            if(rename(temporary.c_str(), target.c_str()) != 0) {
+                std::cerr << "Could not write " << target << std::endl;
+                remove(temporary.c_str());
+            }
+        }
+        else {
+            remove(temporary.c_str());
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->insertions++;
+    this->keep(key, image);
+}
+
+void RenderCache::keep(unsigned long int key, CachedImage image)
+{
+    std::unordered_map<unsigned long int, LRUList::iterator>::iterator
+        found = this->index.find(key);
+    if(found != this->index.end()) {
+        this->bytes -= found->second->second->size();
+        this->entries.erase(found->second);
+        this->index.erase(found);
+    }
+    // an image larger than the whole budget would only evict everything
+    if(image->size() > this->byteBudget)
+        return;
+
+    while(this->bytes + image->size() > this->byteBudget) {
+        this->bytes -= this->entries.back().second->size();
+        this->index.erase(this->entries.back().first);
+        this->entries.pop_back();
+        this->evictions++;
+    }
+    this->entries.push_front(std::make_pair(key, image));
+    this->index[key] = this->entries.begin();
+    this->bytes += image->size();
+}
+
+void RenderCache::clear()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->entries.clear();
+    this->index.clear();
+    this->bytes = 0;
+}
+
+RenderCacheStats RenderCache::getStats()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    RenderCacheStats stats;
+    stats.hits = this->hits;
+    stats.diskHits = this->diskHits;
+    stats.misses = this->misses;
+    stats.insertions = this->insertions;
+    stats.evictions = this->evictions;
+    stats.entries = this->entries.size();
+    stats.bytes = this->bytes;
+    stats.byteBudget = this->byteBudget;
+    return stats;
+}
+
+std::string RenderCache::filename(unsigned long int key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016lx.pbnjcache", key);
+    return this->directory + name;
+}
+
+}
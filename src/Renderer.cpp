@@ -1,12 +1,19 @@
 #include "Camera.h"
+#include "Composite.h"
+#include "JPEGEncoder.h"
+#include "PNGEncoder.h"
 #include "Renderer.h"
 #include "Volume.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <cstring>
+#include <thread>
 #include <vector>
 
 #include <stdlib.h>
@@ -15,26 +22,46 @@
 #include <ospray/ospray.h>
 
 #include "lodepng/lodepng.h"
-#include "CImg.h"
 
 namespace pbnj {
 
 Renderer::Renderer() :
     backgroundColor(), samples(1)
 {
+    OSPRayLock lock;
     this->oRenderer = ospNewRenderer("scivis");
 
-    this->setBackgroundColor(0, 0, 0, 0);
     this->oCamera = NULL;
+    this->pbnjCamera = NULL;
+    this->imageWriter = NULL;
+    this->writeFailed = false;
+    this->renderCache = NULL;
+    this->oFrameBuffer = NULL;
+    this->frameBufferUses = 0;
+    this->sceneVersion = 0;
+    this->committedSceneVersion = 0;
+    this->committedCamera = NULL;
+    this->tileSize = 0;
     this->oModel = NULL;
     this->oSurface = NULL;
     this->oMaterial = NULL;
-    this->lastVolumeID = "unset";
-    this->lastCameraID = "unset";
+    // IDs start at 1, so 0 never matches a real object
+    this->lastVolume = NULL;
+    this->lastSpecular = 0.0;
+    this->lastVolumeID = 0;
+    this->lastVolumeVersion = 0;
+    this->lastCameraID = 0;
+    this->lastCameraVersion = 0;
+    // committed along with the rest of the renderer by the first frame
+    this->setBackgroundColor(0, 0, 0, 0);
 }
 
 Renderer::~Renderer()
 {
+    OSPRayLock lock;
+    // finishes writing any queued images
+    delete this->imageWriter;
+
     ospRemoveParam(this->oRenderer, "bgColor");
     ospRemoveParam(this->oRenderer, "spp");
     ospRemoveParam(this->oRenderer, "lights");
@@ -45,10 +72,12 @@ Renderer::~Renderer()
     ospRemoveParam(this->oRenderer, "camera");
     ospRelease(this->oRenderer);
 
-    ospRelease(this->oCamera);
-
     ospRelease(this->oModel);
 
+    std::map<FrameBufferKey, PooledFrameBuffer>::iterator it;
+    for(it = this->frameBuffers.begin(); it != this->frameBuffers.end(); it++)
+        ospRelease(it->second.frameBuffer);
+
     ospRemoveParam(this->oMaterial, "Kd");
     ospRemoveParam(this->oMaterial, "Ks");
     ospRemoveParam(this->oMaterial, "Ns");
@@ -67,13 +96,14 @@ Renderer::~Renderer()
 
 void Renderer::setBackgroundColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
+    OSPRayLock lock;
     this->backgroundColor[0] = r;
     this->backgroundColor[1] = g;
     this->backgroundColor[2] = b;
     this->backgroundColor[3] = a;
     float asVec[] = {r/(float)255.0, g/(float)255.0, b/(float)255.0, a/(float)255.0};
     ospSet3fv(this->oRenderer, "bgColor", asVec);
-    ospCommit(this->oRenderer);
+    this->sceneVersion++;
 }
 
 void Renderer::setBackgroundColor(std::vector<unsigned char> bgColor)
@@ -90,9 +120,11 @@ void Renderer::setBackgroundColor(std::vector<unsigned char> bgColor)
 
 void Renderer::setVolume(Volume *v)
 {
-    if(this->lastVolumeID == v->ID && this->lastRenderType == "volume") {
-        // this is the same volume as the current model and we previously
-        // did a volume render
+    OSPRayLock lock;
+    if(this->lastVolumeID == v->ID && this->lastRenderType == "volume" &&
+            this->lastVolumeVersion == v->getVersion()) {
+        // this is the same, unchanged volume as the current model and we
+        // previously did a volume render
         return;
     }
     if(this->oModel != NULL) {
@@ -100,15 +132,19 @@ void Renderer::setVolume(Volume *v)
         this->oModel = NULL;
     }
 
+    this->lastVolume = v;
     this->lastVolumeID = v->ID;
+    this->lastVolumeVersion = v->getVersion();
     this->lastRenderType = "volume";
     this->oModel = ospNewModel();
     ospAddVolume(this->oModel, v->asOSPRayObject());
     ospCommit(this->oModel);
+    this->sceneVersion++;
 }
 
 void Renderer::addLight()
 {
+    OSPRayLock lock;
     // currently the renderer will hold only one light
     if(this->lights.size() == 0) {
         // create a new directional light
@@ -120,6 +156,14 @@ void Renderer::addLight()
         ospSet1f(light, "angularDiameter", 0.53);
         ospCommit(light);
         this->lights.push_back(light);
+        // the renderer keeps its own reference to the array, the next
+        // frame commits it
+        OSPData lightDataArray = ospNewData(this->lights.size(), OSP_LIGHT,
+                this->lights.data());
+        ospCommit(lightDataArray);
+        ospSetObject(this->oRenderer, "lights", lightDataArray);
+        ospRelease(lightDataArray);
+        this->sceneVersion++;
     }
 }
 
@@ -131,9 +175,11 @@ void Renderer::setIsosurface(Volume *v, std::vector<float> &isoValues)
 void Renderer::setIsosurface(Volume *v, std::vector<float> &isoValues,
         float specular)
 {
-    if(this->lastVolumeID == v->ID && this->lastRenderType == "isosurface") {
-        // this is the same volume as the current model and we previously
-        // did an isosurface render
+    OSPRayLock lock;
+    if(this->lastVolumeID == v->ID && this->lastRenderType == "isosurface" &&
+            this->lastVolumeVersion == v->getVersion()) {
+        // this is the same, unchanged volume as the current model and we
+        // previously did an isosurface render
 
         // but check if the isoValues are different
         if(this->lastIsoValues == isoValues) {
@@ -150,6 +196,7 @@ void Renderer::setIsosurface(Volume *v, std::vector<float> &isoValues,
     if(this->oMaterial == NULL) {
         // create a new surface material with some specular highlighting
         this->oMaterial = ospNewMaterial(this->oRenderer, "OBJMaterial");
+        this->lastSpecular = specular;
         float Ks[] = {specular, specular, specular};
         float Kd[] = {1.f-specular, 1.f-specular, 1.f-specular};
         ospSet3fv(this->oMaterial, "Kd", Kd);
@@ -170,29 +217,31 @@ void Renderer::setIsosurface(Volume *v, std::vector<float> &isoValues,
     ospSetObject(this->oSurface, "volume", v->asOSPRayObject());
     ospSetMaterial(this->oSurface, this->oMaterial);
     ospCommit(this->oSurface);
+    ospRelease(isoValuesDataArray);
 
+    this->lastVolume = v;
     this->lastVolumeID = v->ID;
+    this->lastVolumeVersion = v->getVersion();
     this->lastRenderType = "isosurface";
     this->lastIsoValues = isoValues;
     this->oModel = ospNewModel();
     ospAddGeometry(this->oModel, this->oSurface);
     ospCommit(this->oModel);
+    this->sceneVersion++;
 }
 
 void Renderer::setCamera(Camera *c)
 {
-    if(this->lastCameraID == c->ID) {
-        // this is the same camera as the current one
+    if(this->lastCameraID == c->ID &&
+            this->lastCameraVersion == c->getVersion()) {
+        // this is the same camera as the current one and it hasn't moved
         return;
     }
-    if(this->oCamera != NULL) {
-        //std::cerr << "Camera already set!" << std::endl;
-        //return;
-        ospRelease(this->oCamera);
-        this->oCamera = NULL;
-    }
+    // the OSPRay camera belongs to the pbnj Camera, which releases it, so
+    // only the reference is replaced here
 
     this->lastCameraID = c->ID;
+    this->lastCameraVersion = c->getVersion();
     this->cameraWidth = c->getImageWidth();
     this->cameraHeight = c->getImageHeight();
     // grab the light direction while we have the pbnj Camera
@@ -205,9 +254,10 @@ void Renderer::setCamera(Camera *c)
 
 void Renderer::setSamples(unsigned int spp)
 {
+    OSPRayLock lock;
     this->samples = spp;
     ospSet1i(this->oRenderer, "spp", spp);
-    ospCommit(this->oRenderer);
+    this->sceneVersion++;
 }
 
 void Renderer::renderImage(std::string imageFilename)
@@ -223,29 +273,195 @@ void Renderer::renderImage(std::string imageFilename)
 
 void Renderer::renderToJPGObject(std::vector<unsigned char> &jpg, int quality)
 {
-    unsigned char *colorBuffer;
-    this->renderToBuffer(&colorBuffer);
+    EncodeSettings settings = this->encodeSettings;
+    settings.jpg.quality = quality;
+    this->renderEncoded(JPG, settings, jpg);
+}
 
-    // CImg doesn't interlace the channels, we have to work around that 
-    cimg_library::CImg<unsigned char> img(colorBuffer, 4, this->cameraWidth, 
-            this->cameraHeight, 1, false);
-    img.permute_axes("yzcx");
+void Renderer::renderToPNGObject(std::vector<unsigned char> &png)
+{
+    this->renderEncoded(PNG, this->encodeSettings, png);
+}
 
-    img.save_jpeg_to_memory(jpg, quality);
-    free(colorBuffer);
+void Renderer::renderToQOIObject(std::vector<unsigned char> &qoi)
+{
+    this->renderEncoded(QOI, this->encodeSettings, qoi);
 }
 
-void Renderer::renderToPNGObject(std::vector<unsigned char> &png)
+void Renderer::renderToRawObject(std::vector<unsigned char> &raw)
 {
-    unsigned char *colorBuffer;
-    this->renderToBuffer(&colorBuffer);
-    unsigned int error = lodepng::encode(png, colorBuffer,
-            this->cameraWidth, this->cameraHeight);
-    if(error) {
-        std::cerr << "ERROR: could not encode PNG, error " << error << ": ";
-        std::cerr << lodepng_error_text(error) << std::endl;
+    this->renderEncoded(RAW, this->encodeSettings, raw);
+}
+
+/*
+ * Renders a frame and encodes it, or copies it from the render cache if
+ * the same frame was encoded the same way before.
+ */
+bool Renderer::renderEncoded(IMAGETYPE imageType,
+        const EncodeSettings &settings, std::vector<unsigned char> &encoded)
+{
+    bool cacheable = this->renderCache != NULL && this->oModel != NULL &&
+        this->pbnjCamera != NULL;
+    unsigned long int key = 0;
+    if(cacheable) {
+        key = this->getCacheKey(imageType, settings);
+        if(this->renderCache->find(key, encoded))
+            return true;
     }
-    free(colorBuffer);
+
+    Image &image = this->frameImage;
+    if(imageType == PIXMAP) {
+        //PPM has no alpha channel, so composite over an opaque background
+        unsigned char background[4] = {this->backgroundColor[0],
+            this->backgroundColor[1], this->backgroundColor[2], 255};
+        if(this->pbnjCamera == NULL) {
+            std::cerr << "No camera set to render with!" << std::endl;
+            return false;
+        }
+        image.resize(this->pbnjCamera->getImageWidth(),
+                this->pbnjCamera->getImageHeight());
+        if(!this->renderInto(image.getData(), image.getStride(), RGBA,
+                    background))
+            return false;
+    }
+    else if(!this->renderToImage(image))
+        return false;
+
+    encodeBuffer(image.getData(), image.getWidth(), image.getHeight(),
+            imageType, settings, encoded);
+    if(encoded.empty())
+        return false;
+    if(cacheable)
+        this->renderCache->insert(key, encoded);
+    return true;
+}
+
+/*
+ * Hashes everything that changes an encoded frame: what is rendered and
+ * how it is classified, the lights, background and samples, the camera
+ * and the output format with its settings.
+ */
+unsigned long int Renderer::getCacheKey(IMAGETYPE imageType,
+        const EncodeSettings &settings)
+{
+    unsigned long int hash = hashBytes(this->lastRenderType.data(),
+            this->lastRenderType.size());
+    std::vector<unsigned long int> parts;
+    if(this->lastVolume != NULL)
+        parts.push_back(this->lastVolume->getHash());
+    if(this->lastRenderType == "isosurface") {
+        parts.push_back(hashBytes(this->lastIsoValues.data(),
+                    this->lastIsoValues.size() * sizeof(float)));
+        parts.push_back(hashBytes(&this->lastSpecular, sizeof(float)));
+    }
+    parts.push_back(this->lights.size());
+    parts.push_back(this->samples);
+    parts.push_back(this->pbnjCamera->getHash());
+    parts.push_back(imageType);
+    if(imageType == PNG) {
+        const PNGSettings &png = settings.png;
+        parts.push_back(png.level);
+        parts.push_back(png.filter);
+        parts.push_back(png.lazyMatching);
+        parts.push_back(png.windowSize);
+        parts.push_back(png.autoConvert);
+    }
+    else if(imageType == JPG) {
+        const JPGSettings &jpg = settings.jpg;
+        parts.push_back(jpg.quality);
+        parts.push_back(jpg.subsampling);
+        parts.push_back(jpg.dct);
+        parts.push_back(jpg.optimizeCoding);
+    }
+    hash = hashBytes(parts.data(), parts.size() * sizeof(unsigned long int),
+            hash);
+    return hashBytes(this->backgroundColor, 4, hash);
+}
+
+/*
+ * Renders on the calling thread, then composites and encodes on another
+ * so the caller can move on to the next frame right away. OSPRay calls
+ * are not safe from several threads, so only the CPU side of the frame
+ * is moved off the calling thread.
+ */
+std::future<std::vector<unsigned char> > Renderer::renderAsync(
+        IMAGETYPE imageType)
+{
+    if(imageType == INVALID) {
+        std::cerr << "Invalid image filetype requested!" << std::endl;
+        return std::future<std::vector<unsigned char> >();
+    }
+    std::vector<unsigned char> raw;
+    if(!this->renderToRaw(raw))
+        return std::future<std::vector<unsigned char> >();
+
+    std::vector<unsigned char> background(this->backgroundColor,
+            this->backgroundColor + 4);
+    return std::async(std::launch::async, &Renderer::compositeAndEncode,
+            std::move(raw), this->cameraWidth, this->cameraHeight,
+            std::move(background), imageType, this->encodeSettings);
+}
+
+std::future<void> Renderer::renderImageAsync(std::string imageFilename)
+{
+    IMAGETYPE imageType = this->getFiletype(imageFilename);
+    if(imageType == INVALID) {
+        std::cerr << "Invalid image filetype requested!" << std::endl;
+        return std::future<void>();
+    }
+    std::vector<unsigned char> raw;
+    if(!this->renderToRaw(raw))
+        return std::future<void>();
+
+    std::vector<unsigned char> background(this->backgroundColor,
+            this->backgroundColor + 4);
+    return std::async(std::launch::async, &Renderer::compositeAndSave,
+            std::move(raw), this->cameraWidth, this->cameraHeight,
+            std::move(background), imageType, imageFilename,
+            this->encodeSettings);
+}
+
+/*
+ * Renders a whole frame and copies the uncomposited OSPRay framebuffer
+ * out so the framebuffer can be reused for the next frame.
+ */
+bool Renderer::renderToRaw(std::vector<unsigned char> &raw)
+{
+    OSPRayLock lock;
+    if(!this->prepareFrame())
+        return false;
+    this->renderPrepared();
+    int size = 4 * this->cameraWidth * this->cameraHeight;
+    const unsigned char *colorBuffer = (const unsigned char *)
+        ospMapFrameBuffer(this->oFrameBuffer, OSP_FB_COLOR);
+    raw.assign(colorBuffer, colorBuffer + size);
+    ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
+    return true;
+}
+
+std::vector<unsigned char> Renderer::compositeAndEncode(
+        std::vector<unsigned char> raw, int width, int height,
+        std::vector<unsigned char> background, IMAGETYPE imageType,
+        EncodeSettings settings)
+{
+    std::vector<unsigned char> composited(4 * width * height);
+    compositeImage(raw.data(), width, height, composited.data(), 4*width,
+            height, 0, 0, background.data());
+    std::vector<unsigned char> encoded;
+    encodeBuffer(composited.data(), width, height, imageType, settings,
+            encoded);
+    return encoded;
+}
+
+void Renderer::compositeAndSave(std::vector<unsigned char> raw, int width,
+        int height, std::vector<unsigned char> background,
+        IMAGETYPE imageType, std::string filename, EncodeSettings settings)
+{
+    std::vector<unsigned char> composited(4 * width * height);
+    compositeImage(raw.data(), width, height, composited.data(), 4*width,
+            height, 0, 0, background.data());
+    writeBuffer(composited.data(), width, height, filename, imageType,
+            settings);
 }
 
 /*
@@ -254,40 +470,277 @@ void Renderer::renderToPNGObject(std::vector<unsigned char> &png)
  */
 void Renderer::renderToBuffer(unsigned char **buffer)
 {
-    this->render();
+    *buffer = NULL;
+    if(this->pbnjCamera == NULL) {
+        std::cerr << "No camera set to render with!" << std::endl;
+        return;
+    }
+    int width = this->pbnjCamera->getImageWidth();
+    int height = this->pbnjCamera->getImageHeight();
+    *buffer = (unsigned char *) malloc(4 * width * height);
+    if(!this->renderInto(*buffer, 4 * width, RGBA, this->backgroundColor)) {
+        free(*buffer);
+        *buffer = NULL;
+    }
+}
+
+bool Renderer::renderToBuffer(unsigned char *buffer, unsigned int stride,
+        PIXELFORMAT format, bool composite)
+{
+    if(this->pbnjCamera == NULL) {
+        std::cerr << "No camera set to render with!" << std::endl;
+        return false;
+    }
+    if(stride == 0)
+        stride = bytesPerPixel(format) * this->pbnjCamera->getImageWidth();
+    const unsigned char *background = NULL;
+    if(composite)
+        background = this->backgroundColor;
+    return this->renderInto(buffer, stride, format, background);
+}
+
+bool Renderer::renderToImage(Image &image)
+{
+    if(this->pbnjCamera == NULL) {
+        std::cerr << "No camera set to render with!" << std::endl;
+        return false;
+    }
+    // only allocates if the image has never been this large
+    image.resize(this->pbnjCamera->getImageWidth(),
+            this->pbnjCamera->getImageHeight());
+    const unsigned char *background = NULL;
+    if(image.getComposite())
+        background = this->backgroundColor;
+    return this->renderInto(image.getData(), image.getStride(),
+            image.getFormat(), background);
+}
+
+/*
+ * Renders a frame straight into out, which must hold the camera's image
+ * size with rows stride bytes apart. The OSPRay framebuffer is mapped and
+ * composited (or just flipped and converted if background is NULL) into
+ * out directly, with no copy in between.
+ */
+bool Renderer::renderInto(unsigned char *out, unsigned int stride,
+        PIXELFORMAT format, const unsigned char *background)
+{
+    if(this->tileSize > 0)
+        return this->renderTiles(out, stride, format, background);
+
+    const unsigned char *colorBuffer;
+    {
+        OSPRayLock lock;
+        if(!this->prepareFrame())
+            return false;
+        this->renderPrepared();
+        colorBuffer = (const unsigned char *)
+            ospMapFrameBuffer(this->oFrameBuffer, OSP_FB_COLOR);
+    }
+    // the framebuffer is this Renderer's own, so other threads can go on
+    // using OSPRay while it is composited
     int width = this->cameraWidth;
     int height = this->cameraHeight;
-    uint32_t *colorBuffer = (uint32_t *)ospMapFrameBuffer(this->oFrameBuffer,
-            OSP_FB_COLOR);
-    
+    compositeImage(colorBuffer, width, height, out, stride, height, 0, 0,
+            background, format);
+    OSPRayLock lock;
+    ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
+    return true;
+}
+
+/*
+ * Keeps accumulating frames into the same framebuffer until OSPRay's
+ * variance estimate drops below varianceThreshold, timeBudget seconds
+ * have passed, maxFrames were rendered or the callback returns false.
+ * The callback sees each intermediate image, composited like
+ * renderToBuffer, and buffer holds the last one. Returns the last
+ * variance estimate. A maxFrames of 0 is rejected and leaves buffer NULL.
+ */
+float Renderer::renderProgressive(unsigned char **buffer,
+        float varianceThreshold, float timeBudget, unsigned int maxFrames,
+        ProgressCallback callback)
+{
+    *buffer = NULL;
+    if(maxFrames == 0) {
+        std::cerr << "Progressive rendering needs at least one frame!";
+        std::cerr << std::endl;
+        return 0;
+    }
+    int channels = OSP_FB_COLOR | OSP_FB_ACCUM | OSP_FB_VARIANCE;
+    {
+        OSPRayLock lock;
+        if(!this->prepareFrame())
+            return 0;
+        // picks up where the last progressive render left off if nothing
+        // changed since then
+        this->oFrameBuffer = this->getFrameBuffer(this->cameraWidth,
+                this->cameraHeight, OSP_FB_SRGBA, channels, true);
+    }
+
+    int width = this->cameraWidth, height = this->cameraHeight;
     *buffer = (unsigned char *) malloc(4 * width * height);
-    
-    for(int j = 0; j < height; j++) {
-        unsigned char *rowIn = (unsigned char*)&colorBuffer[(height-1-j)*width];
-        for(int i = 0; i < width; i++) {
-            int index = j * width + i;
-            // composite rowIn RGB with background color
-            float a = rowIn[4*i + 3] / 255.0;
-            float r = rowIn[4*i + 0] * a,
-                  g = rowIn[4*i + 1] * a,
-                  b = rowIn[4*i + 2] * a;
-            float abg = this->backgroundColor[3] / 255.0;
-            float rbg = this->backgroundColor[0] * abg,
-                  gbg = this->backgroundColor[1] * abg,
-                  bbg = this->backgroundColor[2] * abg;
-
-            (*buffer)[4*index + 0] = (unsigned char) (r + rbg * (1 - a));
-            (*buffer)[4*index + 1] = (unsigned char) (g + gbg * (1 - a));
-            (*buffer)[4*index + 2] = (unsigned char) (b + bbg * (1 - a));
-            (*buffer)[4*index + 3] = (unsigned char) 255 * (a + abg * (1 - a));
+
+    auto start = std::chrono::steady_clock::now();
+    float variance = 0;
+    for(unsigned int frame = 0; frame < maxFrames; frame++) {
+        // the estimate is only available from the second accumulated
+        // frame on, before that OSPRay reports infinity
+        {
+            OSPRayLock lock;
+            variance = ospRenderFrame(this->oFrameBuffer, this->oRenderer,
+                    channels);
         }
+
+        std::chrono::duration<float> elapsed =
+            std::chrono::steady_clock::now() - start;
+        bool done = variance < varianceThreshold ||
+            elapsed.count() >= timeBudget || frame + 1 == maxFrames;
+
+        if(callback || done) {
+            OSPRayLock lock;
+            const unsigned char *colorBuffer = (const unsigned char *)
+                ospMapFrameBuffer(this->oFrameBuffer, OSP_FB_COLOR);
+            compositeImage(colorBuffer, width, height, *buffer, 4*width,
+                    height, 0, 0, this->backgroundColor);
+            ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
+        }
+        if(callback && !callback(*buffer, frame, variance))
+            break;
+        if(done)
+            break;
     }
+    return variance;
+}
 
-    ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
-    ospRelease(this->oFrameBuffer);
+void Renderer::setPNGSettings(const PNGSettings &settings)
+{
+    this->encodeSettings.png = settings;
 }
 
-void Renderer::render()
+void Renderer::setJPGSettings(const JPGSettings &settings)
+{
+    this->encodeSettings.jpg = settings;
+}
+
+void Renderer::setWriteQueue(unsigned int maxQueued)
+{
+    if(this->imageWriter != NULL &&
+            this->imageWriter->getMaxQueued() == maxQueued)
+        return;
+    // writes whatever the old queue still holds, and remembers if any of
+    // it failed for the next flushImages()
+    if(this->imageWriter != NULL && !this->imageWriter->flush())
+        this->writeFailed = true;
+    delete this->imageWriter;
+    this->imageWriter = NULL;
+    if(maxQueued > 0)
+        this->imageWriter = new ImageWriter(maxQueued);
+}
+
+void Renderer::setRenderCache(RenderCache *cache)
+{
+    this->renderCache = cache;
+}
+
+bool Renderer::flushImages()
+{
+    bool succeeded = !this->writeFailed;
+    this->writeFailed = false;
+    if(this->imageWriter != NULL && !this->imageWriter->flush())
+        succeeded = false;
+    return succeeded;
+}
+
+void Renderer::setTileSize(unsigned int size)
+{
+    this->tileSize = size;
+}
+
+/*
+ * Renders the camera's image one region at a time, each into a tile
+ * sized framebuffer, so the full image never has to fit in a single
+ * OSPRay framebuffer. OSPRay already spreads every frame over all cores
+ * and its API can't be called from several threads at once, so tiles are
+ * rendered one after another while the previous tile is composited into
+ * the output on another thread.
+ */
+bool Renderer::renderTiles(unsigned char *out, unsigned int stride,
+        PIXELFORMAT format, const unsigned char *background)
+{
+    {
+        OSPRayLock lock;
+        if(!this->prepareFrame())
+            return false;
+    }
+
+    Camera *camera = this->pbnjCamera;
+    int width = this->cameraWidth, height = this->cameraHeight;
+    int tile = this->tileSize;
+
+    // tiles split whatever region the camera is set to, which is restored
+    // afterward; the camera keeps the full image size so the aspect ratio
+    // of every tile matches the full image
+    float top, right, bottom, left;
+    camera->getRegion(top, right, bottom, left);
+    float regionWidth = right - left, regionHeight = top - bottom;
+
+    std::vector<unsigned char> staging[2];
+    std::thread compositor;
+    int current = 0;
+
+    for(int y = 0; y < height; y += tile) {
+        for(int x = 0; x < width; x += tile) {
+            int tileWidth = std::min(tile, width - x);
+            int tileHeight = std::min(tile, height - y);
+            {
+                OSPRayLock lock;
+                camera->setRegion(
+                        bottom + regionHeight*(y+tileHeight)/height,
+                        left + regionWidth*(x+tileWidth)/width,
+                        bottom + regionHeight*y/height,
+                        left + regionWidth*x/width);
+                camera->commit();
+
+                // at most two tile sizes appear in each direction, so the
+                // pool keeps them all; every tile shows a different
+                // region so nothing accumulates between tiles
+                OSPFrameBuffer frameBuffer = this->getFrameBuffer(
+                        tileWidth, tileHeight, OSP_FB_SRGBA,
+                        OSP_FB_COLOR | OSP_FB_ACCUM, false);
+                ospRenderFrame(frameBuffer, this->oRenderer,
+                        OSP_FB_COLOR | OSP_FB_ACCUM);
+
+                // copy out so the framebuffer can be reused right away,
+                // the other staging buffer may still be in use by the
+                // compositor
+                const unsigned char *colorBuffer = (const unsigned char *)
+                    ospMapFrameBuffer(frameBuffer, OSP_FB_COLOR);
+                staging[current].assign(colorBuffer,
+                        colorBuffer + 4*tileWidth*tileHeight);
+                ospUnmapFrameBuffer(colorBuffer, frameBuffer);
+            }
+
+            if(compositor.joinable())
+                compositor.join();
+            compositor = std::thread(compositeImage,
+                    staging[current].data(), tileWidth, tileHeight, out,
+                    stride, height, x, y, background, format);
+            current = 1 - current;
+        }
+    }
+    if(compositor.joinable())
+        compositor.join();
+
+    camera->setRegion(top, right, bottom, left);
+    return true;
+}
+
+/*
+ * Checks that everything needed is set and commits the camera, and the
+ * light and renderer if they changed since the last frame. Returns false
+ * if a frame can't be rendered. Like the other private functions that
+ * call OSPRay, it expects the caller to hold the OSPRayLock.
+ */
+bool Renderer::prepareFrame()
 {
     //check if everything is ready for rendering
     bool exit = false;
@@ -300,17 +753,23 @@ void Renderer::render()
         exit = true;
     }
     if(exit)
-        return;
+        return false;
+
+    // apply any camera changes made since the last frame, the OSPRay
+    // camera itself is replaced if the projection changed
+    this->pbnjCamera->commit();
+    this->oCamera = this->pbnjCamera->asOSPRayObject();
+    this->cameraWidth = this->pbnjCamera->getImageWidth();
+    this->cameraHeight = this->pbnjCamera->getImageHeight();
+
+    bool sceneChanged = this->committedSceneVersion != this->sceneVersion;
+    this->updateLight(sceneChanged);
 
-    //finalize the OSPRay renderer
+    //the renderer holds on to the camera object, so moving the camera
+    //doesn't need another commit, only replacing it does
+    if(!sceneChanged && this->committedCamera == this->oCamera)
+        return true;
     if(this->lights.size() == 1) {
-        //if there was a light, set its direction based on the camera
-        //and add it to the renderer
-        ospSet3fv(this->lights[0], "direction", this->lightDirection);
-        ospCommit(this->lights[0]);
-        OSPData lightDataArray = ospNewData(this->lights.size(), OSP_LIGHT, this->lights.data());
-        ospCommit(lightDataArray);
-        ospSetObject(this->oRenderer, "lights", lightDataArray);
         unsigned int aoSamples = std::max(this->samples/8, (unsigned int) 1);
         ospSet1i(this->oRenderer, "aoSamples", aoSamples);
         ospSet1i(this->oRenderer, "shadowsEnabled", 0);
@@ -319,19 +778,111 @@ void Renderer::render()
     ospSetObject(this->oRenderer, "model", this->oModel);
     ospSetObject(this->oRenderer, "camera", this->oCamera);
     ospCommit(this->oRenderer);
+    this->committedSceneVersion = this->sceneVersion;
+    this->committedCamera = this->oCamera;
+    return true;
+}
 
-    //set up framebuffer
-    osp::vec2i imageSize;
-    this->cameraWidth = this->pbnjCamera->getImageWidth();
-    this->cameraHeight = this->pbnjCamera->getImageHeight();
-    imageSize.x = this->cameraWidth;
-    imageSize.y = this->cameraHeight;
-    //this framebuffer will be released after a single frame
-    this->oFrameBuffer = ospNewFrameBuffer(imageSize, OSP_FB_SRGBA,
-                                           OSP_FB_COLOR | OSP_FB_ACCUM);
+/*
+ * Points the light, if there is one, along lightDirection when that
+ * changed or force is set. The light is updated in place, so the
+ * renderer doesn't need committing again.
+ */
+void Renderer::updateLight(bool force)
+{
+    if(this->lights.size() != 1)
+        return;
+    if(!force && memcmp(this->lightDirection, this->committedLightDirection,
+                sizeof(this->lightDirection)) == 0)
+        return;
+    ospSet3fv(this->lights[0], "direction", this->lightDirection);
+    ospCommit(this->lights[0]);
+    memcpy(this->committedLightDirection, this->lightDirection,
+            sizeof(this->lightDirection));
+}
+
+void Renderer::render()
+{
+    OSPRayLock lock;
+    if(!this->prepareFrame())
+        return;
+    this->renderPrepared();
+}
+
+void Renderer::renderPrepared()
+{
+    //reuse a framebuffer from the pool, samples keep accumulating into
+    //it as long as nothing in the scene or camera changes
+    this->oFrameBuffer = this->getFrameBuffer(this->cameraWidth,
+            this->cameraHeight, OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM,
+            true);
     ospRenderFrame(this->oFrameBuffer, this->oRenderer,
             OSP_FB_COLOR | OSP_FB_ACCUM);
+}
+
+/*
+ * Everything that invalidates accumulated samples: the renderer's own
+ * settings and model, changes made to the volume in place since it was
+ * set, and which camera is used and where it is.
+ */
+std::vector<unsigned long int> Renderer::getFrameState()
+{
+    std::vector<unsigned long int> state = {this->sceneVersion, 0, 0, 0};
+    if(this->pbnjCamera != NULL) {
+        state[1] = this->pbnjCamera->ID;
+        state[2] = this->pbnjCamera->getVersion();
+    }
+    if(this->lastVolume != NULL)
+        state[3] = this->lastVolume->getVersion();
+    return state;
+}
+
+/*
+ * Returns a framebuffer of the given size and format from the pool,
+ * creating one if needed. The framebuffer is cleared unless accumulate
+ * is set and it was last used for the current scene and camera. The
+ * least recently used framebuffer is released once the pool is full.
+ */
+OSPFrameBuffer Renderer::getFrameBuffer(int width, int height,
+        OSPFrameBufferFormat format, int channels, bool accumulate)
+{
+    FrameBufferKey key(width, height, format, channels);
+    std::vector<unsigned long int> state = this->getFrameState();
+    this->frameBufferUses++;
 
+    std::map<FrameBufferKey, PooledFrameBuffer>::iterator found =
+        this->frameBuffers.find(key);
+    if(found != this->frameBuffers.end()) {
+        PooledFrameBuffer &pooled = found->second;
+        if(!accumulate || pooled.state != state) {
+            ospFrameBufferClear(pooled.frameBuffer, channels);
+            pooled.state = state;
+        }
+        pooled.lastUse = this->frameBufferUses;
+        return pooled.frameBuffer;
+    }
+
+    if(this->frameBuffers.size() >= MAX_POOLED_FRAMEBUFFERS) {
+        std::map<FrameBufferKey, PooledFrameBuffer>::iterator oldest, it;
+        oldest = this->frameBuffers.begin();
+        for(it = this->frameBuffers.begin(); it != this->frameBuffers.end();
+                it++) {
+            if(it->second.lastUse < oldest->second.lastUse)
+                oldest = it;
+        }
+        ospRelease(oldest->second.frameBuffer);
+        this->frameBuffers.erase(oldest);
+    }
+
+    osp::vec2i size;
+    size.x = width;
+    size.y = height;
+    PooledFrameBuffer pooled;
+    pooled.frameBuffer = ospNewFrameBuffer(size, format, channels);
+    pooled.state = state;
+    pooled.lastUse = this->frameBufferUses;
+    this->frameBuffers[key] = pooled;
+    return pooled.frameBuffer;
 }
 
 IMAGETYPE Renderer::getFiletype(std::string filename)
@@ -352,6 +903,12 @@ IMAGETYPE Renderer::getFiletype(std::string filename)
     else if(token.compare("jpg") == 0 || token.compare("jpeg") == 0) {
         return JPG;
     }
+    else if(token.compare("qoi") == 0) {
+        return QOI;
+    }
+    else if(token.compare("rgba") == 0 || token.compare("raw") == 0) {
+        return RAW;
+    }
     else {
         return INVALID;
     }
@@ -365,66 +922,382 @@ void Renderer::saveImage(std::string filename, IMAGETYPE imageType)
         this->saveAsPNG(filename);
     else if (imageType == JPG)
         this->saveAsJPG(filename);
+    else if(imageType == QOI)
+        this->saveAsQOI(filename);
+    else if(imageType == RAW)
+        this->saveAsRaw(filename);
 }
 
 void Renderer::saveAsPPM(std::string filename)
 {
-    this->render();
+    this->saveEncoded(filename, PIXMAP);
+}
+
+void Renderer::saveAsPNG(std::string filename)
+{
+    this->saveEncoded(filename, PNG);
+}
+
+void Renderer::saveAsJPG(std::string filename)
+{
+    this->saveEncoded(filename, JPG);
+}
+
+void Renderer::saveAsQOI(std::string filename)
+{
+    this->saveEncoded(filename, QOI);
+}
+
+void Renderer::saveAsRaw(std::string filename)
+{
+    this->saveEncoded(filename, RAW);
+}
+
+/*
+ * Encodes an already composited RGBA buffer (as produced by renderToBuffer)
+ * into the given image format.
+ */
+void Renderer::encodeBuffer(const unsigned char *buffer, int width,
+        int height, IMAGETYPE imageType, const EncodeSettings &settings,
+        std::vector<unsigned char> &encoded)
+{
+    encoded.clear();
+    if(imageType == PIXMAP) {
+        char header[64];
+        int headerSize = snprintf(header, sizeof(header), "P6\n%i %i\n255\n",
+                width, height);
+        encoded.resize(headerSize + 3*width*height + 1);
+        memcpy(encoded.data(), header, headerSize);
+        //the buffer is already composited, just drop the alpha channel
+        unsigned char *out = encoded.data() + headerSize;
+        for(long int i = 0; i < (long int)width*height; i++) {
+            out[3*i + 0] = buffer[4*i + 0];
+            out[3*i + 1] = buffer[4*i + 1];
+            out[3*i + 2] = buffer[4*i + 2];
+        }
+        encoded.back() = '\n';
+    }
+    else if(imageType == PNG) {
+        unsigned int error = encodePNG(encoded, buffer, width, height,
+                settings.png);
+        if(error) {
+            std::cerr << "ERROR: could not encode PNG, error " << error;
+            std::cerr << ": " << lodepng_error_text(error) << std::endl;
+            encoded.clear();
+        }
+    }
+    else if(imageType == JPG) {
+        // libjpeg reads the interleaved rows as they are
+        encodeJPG(encoded, buffer, width, height, 0, RGBA, settings.jpg);
+    }
+    else if(imageType == QOI) {
+        encodeQOI(encoded, buffer, width, height, 0, RGBA);
+    }
+    else if(imageType == RAW) {
+        encodeRaw(encoded, buffer, width, height, 0, RGBA);
+    }
+}
+
+/*
+ * Writes an already composited RGBA buffer (as produced by renderToBuffer)
+ * to disk. This only touches the buffer, so it is safe to run on another
+ * thread while the next frame renders.
+ */
+void Renderer::writeBuffer(const unsigned char *buffer, int width,
+        int height, std::string filename, IMAGETYPE imageType,
+        const EncodeSettings &settings)
+{
+    std::vector<unsigned char> encoded;
+    encodeBuffer(buffer, width, height, imageType, settings, encoded);
+    if(encoded.empty())
+        return;
+    ImageWriter::writeFile(filename, encoded);
+}
+
+void Renderer::saveEncoded(std::string filename, IMAGETYPE imageType)
+{
+    std::vector<unsigned char> encoded;
+    if(!this->renderEncoded(imageType, this->encodeSettings, encoded))
+        return;
+    if(this->imageWriter == NULL) {
+        ImageWriter::writeFile(filename, encoded);
+        return;
+    }
+    // blocks while the queue is full, so the renderer can't run away
+    // from the disk
+    this->imageWriter->write(filename, encoded);
+}
+
+/*
+ * Renders the camera's image in horizontal bands, each into a band sized
+ * framebuffer through Camera::setRegion(), and streams every band into
+ * the file as soon as it is composited. At most two bands are held at
+ * once, however large the image, and the previous band is composited,
+ * encoded and written while the next one renders.
+ */
+bool Renderer::renderPoster(std::string imageFilename,
+        unsigned int bandHeight)
+{
+    IMAGETYPE imageType = this->getFiletype(imageFilename);
+    if(imageType != PNG && imageType != PIXMAP) {
+        std::cerr << "Posters can only be saved as PNG or PPM!" << std::endl;
+        return false;
+    }
+    {
+        OSPRayLock lock;
+        if(!this->prepareFrame())
+            return false;
+    }
+
+    Camera *camera = this->pbnjCamera;
     int width = this->cameraWidth, height = this->cameraHeight;
-    uint32_t *colorBuffer = (uint32_t *)ospMapFrameBuffer(this->oFrameBuffer,
-            OSP_FB_COLOR);
-    //do a binary file so the PPM isn't quite so large
-    FILE *file = fopen(filename.c_str(), "wb");
-    unsigned char *rowOut = (unsigned char *)malloc(3*width);
-    fprintf(file, "P6\n%i %i\n255\n", width, height);
-
-    //the OSPRay framebuffer uses RGBA, but PPM only supports RGB
-    for(int j = 0; j < height; j++) {
-        unsigned char *rowIn = (unsigned char*)&colorBuffer[(height-1-j)*width];
-        for(int i = 0; i < width; i++) {
-            // composite rowIn RGB with background color
-            unsigned char r = rowIn[4*i + 0],
-                          g = rowIn[4*i + 1],
-                          b = rowIn[4*i + 2];
-            float a = rowIn[4*i + 3] / 255.0;
-            rowOut[3*i + 0] = (unsigned char) r * a + 
-                this->backgroundColor[0] * (1.0-a);
-            rowOut[3*i + 1] = (unsigned char) g * a + 
-                this->backgroundColor[1] * (1.0-a);
-            rowOut[3*i + 2] = (unsigned char) b * a + 
-                this->backgroundColor[2] * (1.0-a);
+    if(bandHeight == 0)
+        bandHeight = std::max(POSTER_BAND_PIXELS / width, 1u);
+    int band = std::min((int)bandHeight, height);
+
+    //PPM has no alpha channel, and over an opaque background every pixel
+    //is opaque, so neither needs to store alpha
+    unsigned char background[4] = {this->backgroundColor[0],
+        this->backgroundColor[1], this->backgroundColor[2],
+        this->backgroundColor[3]};
+    if(imageType == PIXMAP)
+        background[3] = 255;
+    PIXELFORMAT format = background[3] == 255 ? RGB : RGBA;
+
+    FILE *file = fopen(imageFilename.c_str(), "wb");
+    if(file == NULL) {
+        std::cerr << "Could not write " << imageFilename << std::endl;
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    PNGStreamEncoder encoder;
+    std::vector<unsigned char> encoded;
+    // set by the writer thread while the next band renders
+    std::atomic<bool> written(true);
+    if(imageType == PNG) {
+        written = encoder.begin(encoded, width, height, format,
+                this->encodeSettings.png);
+    }
+    else {
+        char header[64];
+        int headerSize = snprintf(header, sizeof(header), "P6\n%i %i\n255\n",
+                width, height);
+        encoded.assign(header, header + headerSize);
+    }
+    if(written)
+        written = fwrite(encoded.data(), 1, encoded.size(), file) ==
+            encoded.size();
+
+    // bands split whatever region the camera is set to, which is restored
+    // afterward
+    float top, right, bottom, left;
+    camera->getRegion(top, right, bottom, left);
+    float regionHeight = top - bottom;
+
+    std::vector<unsigned char> staging[2];
+    std::vector<unsigned char> composited(
+            (unsigned long int)bytesPerPixel(format) * width * band);
+    std::thread writer;
+    int current = 0;
+
+    for(int y = 0; y < height && written; y += band) {
+        int rows = std::min(band, height - y);
+        // y counts rows from the top, OSPRay counts them from the bottom
+        int fromBottom = height - y - rows;
+        {
+            OSPRayLock lock;
+            camera->setRegion(bottom + regionHeight*(fromBottom+rows)/height,
+                    right, bottom + regionHeight*fromBottom/height, left);
+            camera->commit();
+
+            // only the last band can be shorter, so the pool keeps both
+            // sizes
+            OSPFrameBuffer frameBuffer = this->getFrameBuffer(width, rows,
+                    OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM, false);
+            ospRenderFrame(frameBuffer, this->oRenderer,
+                    OSP_FB_COLOR | OSP_FB_ACCUM);
+            const unsigned char *colorBuffer = (const unsigned char *)
+                ospMapFrameBuffer(frameBuffer, OSP_FB_COLOR);
+            staging[current].assign(colorBuffer,
+                    colorBuffer + 4*(unsigned long int)width*rows);
+            ospUnmapFrameBuffer(colorBuffer, frameBuffer);
+        }
+
+        if(writer.joinable())
+            writer.join();
+        if(!written)
+            break;
+        const unsigned char *in = staging[current].data();
+        writer = std::thread([&, in, rows]() {
+            unsigned int stride = bytesPerPixel(format) * width;
+            compositeImage(in, width, rows, composited.data(), stride, rows,
+                    0, 0, background, format);
+            unsigned long int size = (unsigned long int)stride * rows;
+            if(imageType == PNG) {
+                if(!encoder.encodeRows(encoded, composited.data(), rows,
+                            stride)) {
+                    written = false;
+                    return;
+                }
+                written = fwrite(encoded.data(), 1, encoded.size(), file) ==
+                    encoded.size();
+            }
+            else {
+                written = fwrite(composited.data(), 1, size, file) == size;
+            }
+        });
+        current = 1 - current;
+    }
+    if(writer.joinable())
+        writer.join();
+    camera->setRegion(top, right, bottom, left);
+
+    if(written) {
+        if(imageType == PNG)
+            written = encoder.end(encoded);
+        else
+            encoded.assign(1, '\n');
+    }
+    if(written)
+        written = fwrite(encoded.data(), 1, encoded.size(), file) ==
+            encoded.size();
+    if(fclose(file) != 0)
+        written = false;
+    if(!written)
+        std::cerr << "Could not write " << imageFilename << std::endl;
+    return written;
+}
+
+void Renderer::renderPath(std::vector<CameraState> &path,
+        std::vector<std::string> &imageFilenames)
+{
+    if(this->pbnjCamera == NULL) {
+        std::cerr << "No camera set to render with!" << std::endl;
+        return;
+    }
+    if(path.size() != imageFilenames.size()) {
+        std::cerr << "Need one image filename per camera path frame!";
+        std::cerr << std::endl;
+        return;
+    }
+    for(unsigned int frame = 0; frame < imageFilenames.size(); frame++) {
+        if(this->getFiletype(imageFilenames[frame]) == INVALID) {
+            std::cerr << "Invalid image filetype requested: ";
+            std::cerr << imageFilenames[frame] << std::endl;
+            return;
         }
-        fwrite(rowOut, 3*width, sizeof(char), file);
     }
 
-    fprintf(file, "\n");
-    fclose(file);
+    //the scene is committed once and only the camera changes per frame,
+    //the previous frame is encoded and written while the next one renders
+    std::thread writer;
+    Image images[2];
+    int current = 0;
+    for(unsigned int frame = 0; frame < path.size(); frame++) {
+        this->pbnjCamera->setState(path[frame]);
+        //keeps the headlight pointed along the new view direction
+        this->setCamera(this->pbnjCamera);
 
-    //unmap and release so OSPRay will deallocate the memory
-    //used by the framebuffer
-    ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
-    ospRelease(this->oFrameBuffer);
+        //the other image may still be written out
+        if(!this->renderToImage(images[current]))
+            break;
+
+        if(writer.joinable())
+            writer.join();
+        writer = std::thread(&Renderer::writeBuffer,
+                images[current].getData(), this->cameraWidth,
+                this->cameraHeight, imageFilenames[frame],
+                this->getFiletype(imageFilenames[frame]),
+                this->encodeSettings);
+        current = 1 - current;
+    }
+
+    if(writer.joinable())
+        writer.join();
 }
 
-void Renderer::saveAsPNG(std::string filename)
+
+bool Renderer::renderBatch(const std::vector<CameraState> &views,
+        std::vector<Image> &images)
 {
-    std::vector<unsigned char> converted_image;
-    this->renderToPNGObject(converted_image);
-    //write to file
-    lodepng::save_file(converted_image, filename.c_str());
+    // keeps the format, stride and compositing of images already there
+    images.resize(views.size());
+    CameraState original;
+    if(!this->beginBatch(original))
+        return false;
+    bool rendered = true;
+    for(unsigned int view = 0; view < views.size() && rendered; view++)
+        rendered = this->renderView(views[view], images[view]);
+    this->endBatch(original);
+    return rendered;
 }
 
-void Renderer::saveAsJPG(std::string filename)
+/*
+ * Commits the scene for a batch of views and remembers where the camera
+ * was, so endBatch can put it back.
+ */
+bool Renderer::beginBatch(CameraState &original)
 {
-    unsigned char *colorBuffer;
-    this->renderToBuffer(&colorBuffer);
+    if(this->pbnjCamera == NULL) {
+        std::cerr << "No camera set to render with!" << std::endl;
+        return false;
+    }
+    original = this->pbnjCamera->getState();
+    OSPRayLock lock;
+    return this->prepareFrame();
+}
 
-    // CImg doesn't interlace the channels, we have to work around that 
-    cimg_library::CImg<unsigned char> img(colorBuffer, 4, this->cameraWidth, 
-            this->cameraHeight, 1, false);
-    img.permute_axes("yzcx");
+/*
+ * Moves the camera to view and renders it into image. Only the camera and
+ * the light following it are committed again, the renderer stays as
+ * beginBatch committed it.
+ */
+bool Renderer::renderView(const CameraState &view, Image &image)
+{
+    this->pbnjCamera->setState(view);
+    this->lastCameraVersion = this->pbnjCamera->getVersion();
+    for(int i = 0; i < 3; i++)
+        this->lightDirection[i] = view.view[i];
+
+    image.resize(this->cameraWidth, this->cameraHeight);
+    const unsigned char *background = NULL;
+    if(image.getComposite())
+        background = this->backgroundColor;
+    if(this->tileSize > 0)
+        return this->renderTiles(image.getData(), image.getStride(),
+                image.getFormat(), background);
+
+    const unsigned char *colorBuffer;
+    {
+        OSPRayLock lock;
+        this->pbnjCamera->commit();
+        this->updateLight(false);
+        // every view starts from a cleared framebuffer, even if two views
+        // happen to be the same
+        this->oFrameBuffer = this->getFrameBuffer(this->cameraWidth,
+                this->cameraHeight, OSP_FB_SRGBA,
+                OSP_FB_COLOR | OSP_FB_ACCUM, false);
+        ospRenderFrame(this->oFrameBuffer, this->oRenderer,
+                OSP_FB_COLOR | OSP_FB_ACCUM);
+        colorBuffer = (const unsigned char *)
+            ospMapFrameBuffer(this->oFrameBuffer, OSP_FB_COLOR);
+    }
+    // other renderers in a pool can render while this one composites
+    compositeImage(colorBuffer, this->cameraWidth, this->cameraHeight,
+            image.getData(), image.getStride(), this->cameraHeight, 0, 0,
+            background, image.getFormat());
+    OSPRayLock lock;
+    ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
+    return true;
+}
 
-    img.save(filename.c_str());
+void Renderer::endBatch(const CameraState &original)
+{
+    // the next frame commits the camera and points the light again
+    this->pbnjCamera->setState(original);
+    for(int i = 0; i < 3; i++)
+        this->lightDirection[i] = original.view[i];
 }
 
 }
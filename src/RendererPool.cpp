@@ -0,0 +1,191 @@
+#include "Camera.h"
+#include "RendererPool.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace pbnj {
+
+RendererPool::RendererPool(unsigned int size) :
+    queued(0), peakQueued(0), acquisitions(0), reused(0),
+    totalWaitSeconds(0.0), maxWaitSeconds(0.0), busySeconds(0.0)
+{
+    if(size == 0)
+        size = getNumThreads();
+    for(unsigned int i = 0; i < size; i++)
+        this->renderers.push_back(new Renderer());
+    this->inUse.resize(size, false);
+    this->acquiredAt.resize(size);
+    this->lastThread.resize(size);
+    this->created = std::chrono::steady_clock::now();
+}
+
+RendererPool::~RendererPool()
+{
+    for(unsigned int i = 0; i < this->renderers.size(); i++)
+        delete this->renderers[i];
+}
+
+Renderer *RendererPool::acquire()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::thread::id thread = std::this_thread::get_id();
+
+    this->queued++;
+    this->peakQueued = std::max(this->peakQueued, this->queued);
+    int index = -1;
+    while(index < 0) {
+        // the renderer this thread used last already has its scene set
+        // up, so only fall back to another free one if it is taken
+        for(unsigned int i = 0; i < this->renderers.size(); i++) {
+            if(!this->inUse[i] && this->lastThread[i] == thread) {
+                index = i;
+                this->reused++;
+                break;
+            }
+        }
+        for(unsigned int i = 0; i < this->renderers.size() && index < 0;
+                i++) {
+            if(!this->inUse[i])
+                index = i;
+        }
+        if(index < 0)
+            this->available.wait(guard);
+    }
+    this->queued--;
+
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    double waited = std::chrono::duration<double>(now - start).count();
+    this->totalWaitSeconds += waited;
+    this->maxWaitSeconds = std::max(this->maxWaitSeconds, waited);
+    this->acquisitions++;
+
+    this->inUse[index] = true;
+    this->acquiredAt[index] = now;
+    this->lastThread[index] = thread;
+    return this->renderers[index];
+}
+
+void RendererPool::release(Renderer *renderer)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    std::vector<Renderer *>::iterator found = std::find(
+            this->renderers.begin(), this->renderers.end(), renderer);
+    if(found == this->renderers.end()) {
+        std::cerr << "Renderer does not belong to this pool!" << std::endl;
+        return;
+    }
+    unsigned int index = found - this->renderers.begin();
+    if(!this->inUse[index]) {
+        std::cerr << "Renderer was released twice!" << std::endl;
+        return;
+    }
+    this->busySeconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() -
+            this->acquiredAt[index]).count();
+    this->inUse[index] = false;
+    guard.unlock();
+    // wake everyone, a waiting thread may prefer this exact renderer
+    this->available.notify_all();
+}
+
+// releases its renderer when it goes out of scope, even if the function
+// using the renderer throws
+class PooledRenderer {
+    public:
+        PooledRenderer(RendererPool *pool) :
+            pool(pool), renderer(pool->acquire())
+        {
+        }
+        ~PooledRenderer()
+        {
+            this->pool->release(this->renderer);
+        }
+
+        RendererPool *pool;
+        Renderer *renderer;
+};
+
+void RendererPool::render(std::function<void(Renderer *)> func)
+{
+    PooledRenderer pooled(this);
+    func(pooled.renderer);
+}
+
+bool RendererPool::renderBatch(const std::vector<CameraState> &views,
+        std::vector<Image> &images, std::function<void(Renderer *)> setup)
+{
+    images.resize(views.size());
+    unsigned int workers = std::min((unsigned long int)
+            this->renderers.size(), (unsigned long int) views.size());
+    // views are handed out one at a time, so slow views don't hold up a
+    // whole share of the batch
+    std::atomic<unsigned long int> next(0);
+    std::atomic<bool> failed(false);
+
+    std::vector<std::thread> threads;
+    for(unsigned int worker = 0; worker < workers; worker++) {
+        threads.push_back(std::thread([&]() {
+            PooledRenderer pooled(this);
+            Renderer *renderer = pooled.renderer;
+            setup(renderer);
+            CameraState original;
+            if(renderer->beginBatch(original)) {
+                unsigned long int view;
+                while(!failed && (view = next++) < views.size()) {
+                    if(!renderer->renderView(views[view], images[view]))
+                        failed = true;
+                }
+                renderer->endBatch(original);
+            }
+            else
+                failed = true;
+        }));
+    }
+    for(unsigned int worker = 0; worker < workers; worker++)
+        threads[worker].join();
+    return !failed;
+}
+
+unsigned int RendererPool::getSize()
+{
+    return this->renderers.size();
+}
+
+RendererPoolStats RendererPool::getStats()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+
+    RendererPoolStats stats;
+    stats.renderers = this->renderers.size();
+    stats.busy = 0;
+    // count time of renderers that are out right now as well
+    double busySeconds = this->busySeconds;
+    for(unsigned int i = 0; i < this->renderers.size(); i++) {
+        if(this->inUse[i]) {
+            stats.busy++;
+            busySeconds += std::chrono::duration<double>(
+                    now - this->acquiredAt[i]).count();
+        }
+    }
+    stats.queued = this->queued;
+    stats.peakQueued = this->peakQueued;
+    stats.acquisitions = this->acquisitions;
+    stats.reused = this->reused;
+    stats.totalWaitSeconds = this->totalWaitSeconds;
+    stats.maxWaitSeconds = this->maxWaitSeconds;
+    double elapsed = std::chrono::duration<double>(
+            now - this->created).count();
+    stats.utilisation = 0.0;
+    if(elapsed > 0)
+        stats.utilisation = busySeconds / (elapsed * stats.renderers);
+    return stats;
+}
+
+}
@@ -3,6 +3,8 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <sys/sysinfo.h>
 
 namespace pbnj {
@@ -18,7 +20,18 @@ TimeSeries::TimeSeries(std::vector<std::string> filenames,
     this->initSystemInfo();
     // default values for volume attributes
     this->opacityAttenuation = 1.0;
+    this->opacityMode = OPACITY_MANUAL;
+    this->lowPercentile = 0.0;
+    this->highPercentile = 100.0;
+    this->preIntegration = false;
+    this->samplingRate = 0.125;
     this->doMemoryMap = false;
+    this->keyframeTolerance = 1.0 / 1024;
+    this->keyframeTF = NULL;
+    this->colorUploads = 0;
+    this->opacityUploads = 0;
+    this->appliedColors.resize(this->length, 0);
+    this->appliedOpacities.resize(this->length, 0);
 }
 
 TimeSeries::TimeSeries(std::vector<std::string> filenames,
@@ -30,6 +43,20 @@ TimeSeries::TimeSeries(std::vector<std::string> filenames,
     for(int i = 0; i < this->length; i++)
         this->volumes[i] = NULL;
     this->initSystemInfo();
+    // default values for volume attributes
+    this->opacityAttenuation = 1.0;
+    this->opacityMode = OPACITY_MANUAL;
+    this->lowPercentile = 0.0;
+    this->highPercentile = 100.0;
+    this->preIntegration = false;
+    this->samplingRate = 0.125;
+    this->doMemoryMap = false;
+    this->keyframeTolerance = 1.0 / 1024;
+    this->keyframeTF = NULL;
+    this->colorUploads = 0;
+    this->opacityUploads = 0;
+    this->appliedColors.resize(this->length, 0);
+    this->appliedOpacities.resize(this->length, 0);
 }
 
 TimeSeries::~TimeSeries()
@@ -40,6 +67,7 @@ TimeSeries::~TimeSeries()
             this->volumes[i] = NULL;
         }
     }
+    delete this->keyframeTF;
 }
 
 void TimeSeries::initSystemInfo()
@@ -87,6 +115,8 @@ void TimeSeries::encache(unsigned int index)
             // delete the LRU volume
             delete this->volumes[this->lruCache.front()];
             this->volumes[this->lruCache.front()] = NULL;
+            this->appliedColors[this->lruCache.front()] = 0;
+            this->appliedOpacities[this->lruCache.front()] = 0;
             this->lruCache.pop_front();
         }
     }
@@ -117,15 +147,21 @@ Volume *TimeSeries::getVolume(unsigned int index)
                     this->doMemoryMap);
 
         // set any given attributes
-        if(!this->colorMap.empty())
+        this->volumes[index]->setPercentileRange(this->lowPercentile,
+                this->highPercentile);
+        if(!this->colorMap.empty() && this->colorKeyframes.empty())
             this->volumes[index]->setColorMap(this->colorMap);
-        if(!this->opacityMap.empty())
-            this->volumes[index]->setOpacityMap(this->opacityMap);
-        this->volumes[index]->attenuateOpacity(this->opacityAttenuation);
+        if(this->opacityKeyframes.empty())
+            this->applyBaseOpacity(index);
+        this->volumes[index]->setPreIntegration(this->preIntegration);
+        this->volumes[index]->setSamplingRate(this->samplingRate);
 
         // place this volume in cache and/or set it as the newest
         this->encache(index);
     }
+
+    // keyframes may have changed since this volume was loaded
+    this->applyKeyframes(index);
     
     return this->volumes[index];
 }
@@ -176,6 +212,27 @@ void TimeSeries::setOpacityMap(std::vector<float> &map)
     this->opacityMap = map;
 }
 
+void TimeSeries::setAutoOpacityMap(OPACITYMODE mode)
+{
+    this->opacityMode = mode;
+}
+
+void TimeSeries::setPercentileRange(float low, float high)
+{
+    this->lowPercentile = low;
+    this->highPercentile = high;
+}
+
+void TimeSeries::setPreIntegration(bool enabled)
+{
+    this->preIntegration = enabled;
+}
+
+void TimeSeries::setSamplingRate(float rate)
+{
+    this->samplingRate = rate;
+}
+
 void TimeSeries::setOpacityAttenuation(float attenuation)
 {
     this->opacityAttenuation = attenuation;
@@ -186,4 +243,150 @@ void TimeSeries::setMemoryMapping(bool toMMap)
     this->doMemoryMap = toMMap;
 }
 
+void TimeSeries::addKeyframe(unsigned int timestep,
+        std::vector<float> &colorMap, std::vector<float> &opacityMap)
+{
+    // keyframes are resampled to a common length so interpolating between
+    // any two of them is a straight pass over both arrays
+    if(!colorMap.empty())
+        this->colorKeyframes[timestep] = resampleMap(colorMap, 3, 256);
+    if(!opacityMap.empty())
+        this->opacityKeyframes[timestep] = resampleMap(opacityMap, 1, 256);
+}
+
+void TimeSeries::clearKeyframes()
+{
+    // loaded volumes keep their keyframed maps until the next getVolume,
+    // which sees the applied maps with no keyframes left and puts the
+    // base maps back
+    this->colorKeyframes.clear();
+    this->opacityKeyframes.clear();
+}
+
+void TimeSeries::setKeyframeTolerance(float tolerance)
+{
+    if(tolerance <= 0.0) {
+        std::cerr << "WARNING: Keyframe tolerance must be positive. ";
+        std::cerr << "Keeping tolerance at previous value" << std::endl;
+        return;
+    }
+    this->keyframeTolerance = tolerance;
+}
+
+bool TimeSeries::interpolateKeyframes(
+        std::map<unsigned int, std::vector<float>> &keyframes,
+        unsigned int timestep, std::vector<float> &map)
+{
+    if(keyframes.empty())
+        return false;
+
+    // first keyframe at or after this timestep
+    auto next = keyframes.lower_bound(timestep);
+    if(next == keyframes.end()) {
+        map = keyframes.rbegin()->second;
+        return true;
+    }
+    if(next->first == timestep || next == keyframes.begin()) {
+        map = next->second;
+        return true;
+    }
+    auto previous = std::prev(next);
+
+    float t = (timestep - previous->first) /
+        (float)(next->first - previous->first);
+    const float *a = previous->second.data();
+    const float *b = next->second.data();
+    unsigned int size = previous->second.size();
+    map.resize(size);
+    float *out = map.data();
+    // simple enough for the compiler to vectorize
+    for(unsigned int i = 0; i < size; i++)
+        out[i] = a[i] + t * (b[i] - a[i]);
+    return true;
+}
+
+bool TimeSeries::quantizeChanged(std::vector<float> &map,
+        std::vector<int> &applied)
+{
+    float scale = 1.0 / this->keyframeTolerance;
+    std::vector<int> quantized(map.size());
+    for(unsigned int i = 0; i < map.size(); i++)
+        quantized[i] = (int) std::lround(map[i] * scale);
+    if(quantized == applied)
+        return false;
+    applied.swap(quantized);
+    return true;
+}
+
+void TimeSeries::applyKeyframes(unsigned int index)
+{
+    // created here rather than in the constructor, which may run before
+    // OSPRay is initialized
+    if(this->keyframeTF == NULL &&
+            !(this->colorKeyframes.empty() && this->opacityKeyframes.empty()))
+        this->keyframeTF = new TransferFunction();
+
+    std::vector<float> map;
+    if(this->interpolateKeyframes(this->colorKeyframes, index, map)) {
+        // compared with the last upload whichever timestep it was for, so
+        // stretches of timesteps with the same table share one upload
+        if(this->quantizeChanged(map, this->uploadedColors)) {
+            this->keyframeTF->setColorMap(map);
+            this->colorUploads++;
+        }
+        if(this->appliedColors[index] != this->colorUploads) {
+            this->volumes[index]->shareColorMap(this->keyframeTF);
+            this->appliedColors[index] = this->colorUploads;
+        }
+    }
+    else if(this->appliedColors[index] != 0) {
+        // the keyframes were cleared since this volume last got a map
+        this->applyBaseColor(index);
+        this->appliedColors[index] = 0;
+    }
+
+    if(this->interpolateKeyframes(this->opacityKeyframes, index, map)) {
+        if(this->opacityAttenuation < 1.0)
+            for(unsigned int i = 0; i < map.size(); i++)
+                map[i] *= this->opacityAttenuation;
+        if(this->quantizeChanged(map, this->uploadedOpacities)) {
+            this->keyframeTF->setOpacityMap(map);
+            this->opacityUploads++;
+        }
+        if(this->appliedOpacities[index] != this->opacityUploads) {
+            this->volumes[index]->shareOpacityMap(this->keyframeTF);
+            this->appliedOpacities[index] = this->opacityUploads;
+        }
+    }
+    else if(this->appliedOpacities[index] != 0) {
+        this->applyBaseOpacity(index);
+        this->appliedOpacities[index] = 0;
+    }
+}
+
+void TimeSeries::applyBaseColor(unsigned int index)
+{
+    // without a given map, go back to the transfer function's default
+    // black to white ramp
+    std::vector<float> map(this->colorMap);
+    if(map.empty())
+        for(int i = 0; i < 256; i++)
+            for(int c = 0; c < 3; c++)
+                map.push_back(i/255.0);
+    this->volumes[index]->setColorMap(map);
+}
+
+void TimeSeries::applyBaseOpacity(unsigned int index)
+{
+    // without a given map, go back to the transfer function's default ramp
+    std::vector<float> map(this->opacityMap);
+    if(map.empty())
+        for(int i = 0; i < 256; i++)
+            map.push_back(i/255.0);
+    this->volumes[index]->setOpacityMap(map);
+    // a generated map replaces any given opacity map
+    this->volumes[index]->setAutoOpacityMap(this->opacityMode);
+    this->volumes[index]->attenuateOpacity(this->opacityAttenuation);
+}
+
 }
@@ -1,12 +1,35 @@
 #include "TransferFunction.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
 namespace pbnj {
 
-TransferFunction::TransferFunction()
+std::vector<float> resampleMap(std::vector<float> &map, unsigned int channels,
+        unsigned int length)
 {
+    std::vector<float> out(channels * length);
+    unsigned int entries = map.size() / channels;
+    if(entries == 0)
+        return out;
+    for(unsigned int i = 0; i < length; i++) {
+        float p = (length > 1 ? i / (float)(length - 1) : 0) * (entries - 1);
+        unsigned int p0 = std::min((unsigned int) p, entries - 1);
+        unsigned int p1 = std::min(p0 + 1, entries - 1);
+        float t = p - p0;
+        for(unsigned int c = 0; c < channels; c++)
+            out[channels*i + c] = (1 - t) * map[channels*p0 + c] +
+                t * map[channels*p1 + c];
+    }
+    return out;
+}
+
+TransferFunction::TransferFunction() :
+    version(0), hash(0), hashVersion(~0ul)
+{
+    OSPRayLock lock;
     this->colorMap.reserve(256*3);
     this->opacityMap.reserve(256);
 
@@ -32,13 +55,17 @@ TransferFunction::TransferFunction()
 
 TransferFunction::~TransferFunction()
 {
+    OSPRayLock lock;
     ospRelease(this->oTF);
-    ospRelease(this->oColorData);
-    ospRelease(this->oOpacityData);
+    if(this->oColorData != NULL)
+        ospRelease(this->oColorData);
+    if(this->oOpacityData != NULL)
+        ospRelease(this->oOpacityData);
 }
 
 void TransferFunction::setRange(float minimum, float maximum)
 {
+    OSPRayLock lock;
     if(minimum > maximum) {
         std::cerr << "Minimum is larger than maximum!" << std::endl;
         return;
@@ -50,19 +77,35 @@ void TransferFunction::setRange(float minimum, float maximum)
     float temp[] = {this->minVal, this->maxVal};
     ospSet2fv(this->oTF, "valueRange", temp);
     ospCommit(this->oTF);
+    this->version++;
+}
+
+float TransferFunction::getMinimum()
+{
+    return this->minVal;
+}
+
+float TransferFunction::getMaximum()
+{
+    return this->maxVal;
 }
 
 void TransferFunction::attenuateOpacity(float amount)
 {
+    OSPRayLock lock;
     if(amount >= 1.0)
         return;
     for(int i = 0; i < this->opacityMap.size(); i++)
         this->opacityMap[i] = this->opacityMap[i] * amount;
 
+    // transfer functions sharing the old data keep it alive
+    if(this->oOpacityData != NULL)
+        ospRelease(this->oOpacityData);
     this->oOpacityData = ospNewData(this->opacityMap.size(), OSP_FLOAT,
             this->opacityMap.data());
     ospSetData(this->oTF, "opacities", this->oOpacityData);
     ospCommit(this->oTF);
+    this->version++;
 }
 
 OSPTransferFunction TransferFunction::asOSPObject()
@@ -72,6 +115,7 @@ OSPTransferFunction TransferFunction::asOSPObject()
 
 void TransferFunction::setColorMap(std::vector<float> &map)
 {
+    OSPRayLock lock;
     //map may be empty if the config file is used
     if(map.empty())
         return;
@@ -85,15 +129,20 @@ void TransferFunction::setColorMap(std::vector<float> &map)
     for(int i = 0; i < map.size(); i++)
         this->colorMap.push_back(map[i]);
 
+    // transfer functions sharing the old data keep it alive
+    if(this->oColorData != NULL)
+        ospRelease(this->oColorData);
     this->oColorData = ospNewData(this->colorMap.size() / 3, OSP_FLOAT3,
             this->colorMap.data());
     ospSetData(this->oTF, "colors", this->oColorData);
 
     ospCommit(this->oTF);
+    this->version++;
 }
 
 void TransferFunction::setOpacityMap(std::vector<float> &map)
 {
+    OSPRayLock lock;
     //map may be empty if the config file is used
     if(map.empty())
         return;
@@ -106,10 +155,113 @@ void TransferFunction::setOpacityMap(std::vector<float> &map)
     for(int i = 0; i < map.size(); i++)
         this->opacityMap.push_back(map[i]);
 
+    // transfer functions sharing the old data keep it alive
+    if(this->oOpacityData != NULL)
+        ospRelease(this->oOpacityData);
     this->oOpacityData = ospNewData(this->opacityMap.size(), OSP_FLOAT,
             this->opacityMap.data());
     ospSetData(this->oTF, "opacities", this->oOpacityData);
     ospCommit(this->oTF);
+    this->version++;
+}
+
+void TransferFunction::shareColorMap(TransferFunction *other)
+{
+    OSPRayLock lock;
+    if(other->oColorData == NULL) {
+        // it borrows its data from elsewhere, upload a copy instead
+        std::vector<float> map(other->colorMap);
+        this->setColorMap(map);
+        return;
+    }
+    this->colorMap = other->colorMap;
+    // only the other transfer function holds a handle, the parameter
+    // keeps the data alive for as long as this one uses it
+    if(this->oColorData != NULL)
+        ospRelease(this->oColorData);
+    this->oColorData = NULL;
+    ospSetData(this->oTF, "colors", other->oColorData);
+    ospCommit(this->oTF);
+    this->version++;
+}
+
+void TransferFunction::shareOpacityMap(TransferFunction *other)
+{
+    OSPRayLock lock;
+    if(other->oOpacityData == NULL) {
+        std::vector<float> map(other->opacityMap);
+        this->setOpacityMap(map);
+        return;
+    }
+    this->opacityMap = other->opacityMap;
+    if(this->oOpacityData != NULL)
+        ospRelease(this->oOpacityData);
+    this->oOpacityData = NULL;
+    ospSetData(this->oTF, "opacities", other->oOpacityData);
+    ospCommit(this->oTF);
+    this->version++;
+}
+
+void TransferFunction::setOpacityFromHistogram(
+        std::vector<unsigned long int> &histogram, OPACITYMODE mode)
+{
+    if(histogram.empty() || mode == OPACITY_MANUAL)
+        return;
+
+    unsigned long int total = 0, largest = 0;
+    for(size_t b = 0; b < histogram.size(); b++) {
+        total += histogram[b];
+        largest = std::max(largest, histogram[b]);
+    }
+    if(total == 0)
+        return;
+
+    // per-bin opacity, resampled below to the usual 256 entries
+    std::vector<float> binOpacity(histogram.size());
+    if(mode == OPACITY_EQUALIZE) {
+        unsigned long int cumulative = 0;
+        for(size_t b = 0; b < histogram.size(); b++) {
+            cumulative += histogram[b];
+            binOpacity[b] = cumulative / (float) total;
+        }
+    }
+    else if(mode == OPACITY_RARE) {
+        // log scale so a huge background peak doesn't flatten everything
+        // else to the same value, empty bins stay transparent
+        float logLargest = std::log1p((float) largest);
+        for(size_t b = 0; b < histogram.size(); b++) {
+            if(histogram[b] == 0 || logLargest == 0)
+                binOpacity[b] = 0.0;
+            else
+                binOpacity[b] = 1.0 -
+                    std::log1p((float) histogram[b]) / logLargest;
+        }
+    }
+
+    std::vector<float> map(256);
+    for(size_t i = 0; i < map.size(); i++)
+        map[i] = binOpacity[i * binOpacity.size() / map.size()];
+
+    this->setOpacityMap(map);
+}
+
+unsigned long int TransferFunction::getVersion()
+{
+    return this->version;
+}
+
+unsigned long int TransferFunction::getHash()
+{
+    if(this->hashVersion != this->version) {
+        unsigned long int hash = hashBytes(this->colorMap.data(),
+                this->colorMap.size() * sizeof(float));
+        hash = hashBytes(this->opacityMap.data(),
+                this->opacityMap.size() * sizeof(float), hash);
+        hash = hashBytes(&this->minVal, sizeof(float), hash);
+        this->hash = hashBytes(&this->maxVal, sizeof(float), hash);
+        this->hashVersion = this->version;
+    }
+    return this->hash;
 }
 
 }
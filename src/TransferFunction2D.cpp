@@ -0,0 +1,156 @@
+#include "TransferFunction.h"
+#include "TransferFunction2D.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace pbnj {
+
+TransferFunction2D::TransferFunction2D(unsigned int valueBins,
+        unsigned int gradientBins) :
+    valueBins(std::max(valueBins, (unsigned int) 2)),
+    gradientBins(std::max(gradientBins, (unsigned int) 1)),
+    gradientMin(0.0), gradientMax(0.0), version(0), hash(0),
+    hashVersion(~0ul)
+{
+    //default black to white color map, ramp opacity in both directions
+    for(int i = 0; i < 256; i++) {
+        this->colorMap.push_back(i/255.0);
+        this->colorMap.push_back(i/255.0);
+        this->colorMap.push_back(i/255.0);
+        this->opacityMap.push_back(i/255.0);
+        this->gradientOpacityMap.push_back(i/255.0);
+    }
+    this->buildTable();
+}
+
+void TransferFunction2D::setColorMap(std::vector<float> &map)
+{
+    //map may be empty if the config file is used
+    if(map.empty())
+        return;
+    this->colorMap = map;
+    this->buildTable();
+}
+
+void TransferFunction2D::setOpacityMap(std::vector<float> &map)
+{
+    if(map.empty())
+        return;
+    this->opacityMap = map;
+    this->buildTable();
+}
+
+void TransferFunction2D::setGradientOpacityMap(std::vector<float> &map)
+{
+    if(map.empty())
+        return;
+    this->gradientOpacityMap = map;
+    this->buildTable();
+}
+
+void TransferFunction2D::setEntry(unsigned int valueBin,
+        unsigned int gradientBin, float r, float g, float b, float a)
+{
+    if(valueBin >= this->valueBins || gradientBin >= this->gradientBins) {
+        std::cerr << "Entry (" << valueBin << ", " << gradientBin;
+        std::cerr << ") is outside of the transfer function!" << std::endl;
+        return;
+    }
+    float *entry = &this->table[4 * (gradientBin*this->valueBins + valueBin)];
+    entry[0] = r;
+    entry[1] = g;
+    entry[2] = b;
+    entry[3] = a;
+    this->version++;
+}
+
+void TransferFunction2D::setGradientRange(float minimum, float maximum)
+{
+    if(minimum > maximum) {
+        std::cerr << "Minimum is larger than maximum!" << std::endl;
+        return;
+    }
+    this->gradientMin = minimum;
+    this->gradientMax = maximum;
+    this->version++;
+}
+
+float TransferFunction2D::getGradientMinimum()
+{
+    return this->gradientMin;
+}
+
+float TransferFunction2D::getGradientMaximum()
+{
+    return this->gradientMax;
+}
+
+unsigned int TransferFunction2D::getValueBins()
+{
+    return this->valueBins;
+}
+
+unsigned int TransferFunction2D::getGradientBins()
+{
+    return this->gradientBins;
+}
+
+unsigned long int TransferFunction2D::getVersion()
+{
+    return this->version;
+}
+
+unsigned long int TransferFunction2D::getHash()
+{
+    if(this->hashVersion != this->version) {
+        unsigned long int hash = hashBytes(this->table.data(),
+                this->table.size() * sizeof(float));
+        hash = hashBytes(&this->valueBins, sizeof(unsigned int), hash);
+        hash = hashBytes(&this->gradientBins, sizeof(unsigned int), hash);
+        hash = hashBytes(&this->gradientMin, sizeof(float), hash);
+        this->hash = hashBytes(&this->gradientMax, sizeof(float), hash);
+        this->hashVersion = this->version;
+    }
+    return this->hash;
+}
+
+void TransferFunction2D::classify(float value, float gradient, float *rgba)
+{
+    value = std::max(0.f, std::min(value, 1.f));
+    gradient = std::max(0.f, std::min(gradient, 1.f));
+    unsigned int row = std::min((unsigned int)(gradient * this->gradientBins),
+            this->gradientBins - 1);
+    float position = value * (this->valueBins - 1);
+    unsigned int column = std::min((unsigned int) position,
+            this->valueBins - 2);
+    float t = position - column;
+    const float *a = &this->table[4 * (row*this->valueBins + column)];
+    const float *b = a + 4;
+    for(int c = 0; c < 4; c++)
+        rgba[c] = a[c] + t * (b[c] - a[c]);
+}
+
+void TransferFunction2D::buildTable()
+{
+    std::vector<float> colors = resampleMap(this->colorMap, 3, this->valueBins);
+    std::vector<float> opacities = resampleMap(this->opacityMap, 1,
+            this->valueBins);
+    std::vector<float> gradientOpacities = resampleMap(this->gradientOpacityMap,
+            1, this->gradientBins);
+
+    this->table.resize(4 * this->valueBins * this->gradientBins);
+    for(unsigned int g = 0; g < this->gradientBins; g++) {
+        for(unsigned int v = 0; v < this->valueBins; v++) {
+            float *entry = &this->table[4 * (g*this->valueBins + v)];
+            entry[0] = colors[3*v + 0];
+            entry[1] = colors[3*v + 1];
+            entry[2] = colors[3*v + 2];
+            entry[3] = opacities[v] * gradientOpacities[g];
+        }
+    }
+    this->version++;
+}
+
+}
@@ -1,9 +1,17 @@
 #include "Volume.h"
 #include "DataFile.h"
+#include "Parallel.h"
+#include "QuantileSketch.h"
 #include "TransferFunction.h"
+#include "TransferFunction2D.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 #include <vector>
 
+#include <stdlib.h>
+
 #include <ospray/ospray.h>
 
 namespace pbnj {
@@ -11,6 +19,7 @@ namespace pbnj {
 Volume::Volume(std::string filename, int x, int y, int z, bool memmap)
 {
     this->ID = createID();
+    this->version = 0;
     //volumes contain a datafile
     //one datafile per volume, one volume per renderer/camera
     this->dataFile = new DataFile(x, y, z);
@@ -23,6 +32,7 @@ Volume::Volume(std::string filename, std::string var_name, int x, int y, int z,
         bool memmap)
 {
     this->ID = createID();
+    this->version = 0;
     //volumes contain a datafile
     //one datafile per volume, one volume per renderer/camera
     this->dataFile = new DataFile(x, y, z);
@@ -33,6 +43,11 @@ Volume::Volume(std::string filename, std::string var_name, int x, int y, int z,
 
 void Volume::init()
 {
+    OSPRayLock lock;
+    // OSPRay's defaults
+    this->preIntegration = false;
+    this->samplingRate = 0.125;
+
     //set up default transfer function
     this->transferFunction = new TransferFunction();
     this->transferFunction->setRange(this->dataFile->minVal,
@@ -62,10 +77,14 @@ void Volume::init()
     ospSetObject(this->oVolume, "transferFunction",
             this->transferFunction->asOSPObject());
     ospCommit(this->oVolume);
+
+    // gradients are computed on first use
+    this->gradientCeiling = -1.0;
 }
 
 Volume::~Volume()
 {
+    OSPRayLock lock;
     delete this->dataFile;
     this->dataFile = NULL;
     delete this->transferFunction;
@@ -76,6 +95,8 @@ Volume::~Volume()
     ospRemoveParam(this->oVolume, "voxelRange");
     ospRemoveParam(this->oVolume, "gridOrigin");
     ospRemoveParam(this->oVolume, "transferFunction");
+    ospRemoveParam(this->oVolume, "preIntegration");
+    ospRemoveParam(this->oVolume, "samplingRate");
     ospRelease(this->oVolume);
     ospRelease(this->oData);
 }
@@ -83,16 +104,88 @@ Volume::~Volume()
 void Volume::attenuateOpacity(float amount)
 {
     this->transferFunction->attenuateOpacity(amount);
+    this->version++;
 }
 
 void Volume::setColorMap(std::vector<float> &map)
 {
     this->transferFunction->setColorMap(map);
+    this->version++;
 }
 
 void Volume::setOpacityMap(std::vector<float> &map)
 {
     this->transferFunction->setOpacityMap(map);
+    this->version++;
+}
+
+void Volume::setAutoOpacityMap(OPACITYMODE mode)
+{
+    if(mode == OPACITY_MANUAL)
+        return;
+    // bins need to span the same values as the transfer function
+    float minimum = this->transferFunction->getMinimum();
+    float maximum = this->transferFunction->getMaximum();
+    if(this->opacityHistogram.empty() ||
+            this->opacityHistogramRange[0] != minimum ||
+            this->opacityHistogramRange[1] != maximum) {
+        this->opacityHistogram = this->dataFile->histogram(256, minimum,
+                maximum);
+        this->opacityHistogramRange[0] = minimum;
+        this->opacityHistogramRange[1] = maximum;
+    }
+    this->transferFunction->setOpacityFromHistogram(this->opacityHistogram,
+            mode);
+    this->version++;
+}
+
+void Volume::shareColorMap(TransferFunction *tf)
+{
+    this->transferFunction->shareColorMap(tf);
+    this->version++;
+}
+
+void Volume::shareOpacityMap(TransferFunction *tf)
+{
+    this->transferFunction->shareOpacityMap(tf);
+    this->version++;
+}
+
+void Volume::setPercentileRange(float lowPercentile, float highPercentile)
+{
+    if(lowPercentile > highPercentile) {
+        std::cerr << "Low percentile is larger than high percentile!";
+        std::cerr << std::endl;
+        return;
+    }
+    this->transferFunction->setRange(
+            this->dataFile->percentile(lowPercentile),
+            this->dataFile->percentile(highPercentile));
+    this->version++;
+}
+
+void Volume::setPreIntegration(bool enabled)
+{
+    OSPRayLock lock;
+    // OSPRay builds and caches its own pre-integrated table from the
+    // transfer function when this is on
+    ospSet1i(this->oVolume, "preIntegration", enabled ? 1 : 0);
+    ospCommit(this->oVolume);
+    this->preIntegration = enabled;
+    this->version++;
+}
+
+void Volume::setSamplingRate(float rate)
+{
+    OSPRayLock lock;
+    if(rate <= 0.0) {
+        std::cerr << "Sampling rate must be positive!" << std::endl;
+        return;
+    }
+    ospSet1f(this->oVolume, "samplingRate", rate);
+    ospCommit(this->oVolume);
+    this->samplingRate = rate;
+    this->version++;
 }
 
 std::vector<long unsigned int> Volume::getBounds()
@@ -102,11 +195,121 @@ std::vector<long unsigned int> Volume::getBounds()
     return bounds;
 }
 
+const std::vector<float> &Volume::getGradientMagnitude()
+{
+    if(!this->gradientMagnitude.empty())
+        return this->gradientMagnitude;
+    this->gradientMagnitude.resize(this->dataFile->numValues);
+    this->computeGradientMagnitude(this->gradientMagnitude.data());
+    return this->gradientMagnitude;
+}
+
+/*
+ * Central difference gradient magnitude of every voxel into magnitude,
+ * which holds one float per voxel. Also sets gradientCeiling.
+ */
+void Volume::computeGradientMagnitude(float *magnitude)
+{
+    long int xDim = this->dataFile->xDim, yDim = this->dataFile->yDim,
+         zDim = this->dataFile->zDim;
+    const float *data = this->dataFile->data;
+
+    // z slices are split across threads, each keeps a sketch of its
+    // magnitudes so the default gradient range ignores a few extreme edges
+    std::vector<QuantileSketch> sketches(getNumThreads());
+    parallelFor(zDim, [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        for(long int z = start; z < (long int) end; z++) {
+            // central differences, one-sided on the faces of the volume
+            long int z0 = std::max(z - 1, 0L), z1 = std::min(z + 1, zDim - 1);
+            for(long int y = 0; y < yDim; y++) {
+                long int y0 = std::max(y - 1, 0L),
+                     y1 = std::min(y + 1, yDim - 1);
+                for(long int x = 0; x < xDim; x++) {
+                    long int x0 = std::max(x - 1, 0L),
+                         x1 = std::min(x + 1, xDim - 1);
+                    long int row = (z*yDim + y) * xDim;
+                    float dx = (data[row + x1] - data[row + x0]) /
+                        std::max(x1 - x0, 1L);
+                    float dy = (data[(z*yDim + y1)*xDim + x] -
+                            data[(z*yDim + y0)*xDim + x]) /
+                        std::max(y1 - y0, 1L);
+                    float dz = (data[(z1*yDim + y)*xDim + x] -
+                            data[(z0*yDim + y)*xDim + x]) /
+                        std::max(z1 - z0, 1L);
+                    magnitude[row + x] = std::sqrt(dx*dx + dy*dy + dz*dz);
+                    sketches[thread].add(magnitude[row + x]);
+                }
+            }
+        }
+    });
+
+    for(unsigned int t = 1; t < sketches.size(); t++)
+        sketches[0].merge(sketches[t]);
+    this->gradientCeiling = sketches[0].quantile(0.99);
+}
+
+unsigned long int Volume::getVersion()
+{
+    return this->version;
+}
+
+unsigned long int Volume::getHash()
+{
+    // the ID is only unique within this process, the cache directory can
+    // be shared between processes, so the data is identified by where it
+    // was loaded from instead
+    const DataFile *file = this->dataFile;
+    std::string path = file->filename;
+    char *absolute = realpath(file->filename.c_str(), NULL);
+    if(absolute != NULL) {
+        path = absolute;
+        free(absolute);
+    }
+    unsigned long int hash = hashBytes(path.data(), path.size());
+    hash = hashBytes(file->variable.data(), file->variable.size(), hash);
+    unsigned long int identity[4] = {file->xDim, file->yDim, file->zDim,
+        (unsigned long int) file->modifiedTime};
+    hash = hashBytes(identity, sizeof(identity), hash);
+    unsigned long int tfHash = this->transferFunction->getHash();
+    hash = hashBytes(&tfHash, sizeof(tfHash), hash);
+    hash = hashBytes(&this->preIntegration, sizeof(bool), hash);
+    return hashBytes(&this->samplingRate, sizeof(float), hash);
+}
+
 OSPVolume Volume::asOSPRayObject()
 {
     return this->oVolume;
 }
 
+void Volume::classify(TransferFunction2D *tf, std::vector<float> &rgba)
+{
+    const std::vector<float> &gradients = this->getGradientMagnitude();
+    float gradientMin = tf->getGradientMinimum();
+    float gradientMax = tf->getGradientMaximum();
+    if(gradientMax <= gradientMin) {
+        gradientMin = 0.0;
+        gradientMax = this->gradientCeiling;
+    }
+    float valueMin = this->transferFunction->getMinimum();
+    float valueMax = this->transferFunction->getMaximum();
+    float valueScale = valueMax > valueMin ? 1.0 / (valueMax - valueMin) : 0.0;
+    float gradientScale = gradientMax > gradientMin ?
+        1.0 / (gradientMax - gradientMin) : 0.0;
+
+    rgba.resize(4 * this->dataFile->numValues);
+    const float *data = this->dataFile->data;
+    float *out = rgba.data();
+    parallelFor(this->dataFile->numValues,
+            [&](unsigned long int start, unsigned long int end,
+                unsigned int thread) {
+        for(unsigned long int i = start; i < end; i++)
+            tf->classify((data[i] - valueMin) * valueScale,
+                    (gradients[i] - gradientMin) * gradientScale,
+                    &out[4*i]);
+    }, 1 << 16);
+}
+
 void Volume::loadFromFile(std::string filename, std::string var_name,
         bool memmap)
 {
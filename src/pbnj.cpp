@@ -2,61 +2,51 @@
 
 #include <ospray/ospray.h>
 
-#include <chrono>
-#include <iostream>
-#include <string>
-#include <stdio.h>
-#include <string.h>
+#include <atomic>
+#include <mutex>
 
 namespace pbnj {
 
+// recursive so functions holding it can call each other
+static std::recursive_mutex ospLock;
+
 void pbnjInit(int *argc, const char **argv)
 {
     // eventually this can parse argv for pbnj flags, eg for config files
     // just call OSPRay initialization for now though
     // NOTE: this MUST be called after reading a config file!
+    OSPRayLock lock;
     ospInit(argc, argv);
 }
 
-std::string createID()
+OSPRayLock::OSPRayLock()
 {
-    // IDs are composed of a MAC address followed by a time
-    FILE *arp = fopen("/proc/net/arp", "r");
-    if(arp == NULL) {
-        std::cerr << "WARNING: Could not open /proc/net/arp. ";
-        std::cerr << "Object IDs won't work." << std::endl;
-        return "";
-    }
-
-    char buffer[1024];
-    // read the column headers
-    char *header = fgets(buffer, 1024, arp);
-    if(header == NULL) {
-        std::cerr << "WARNING: Unexpected format in /proc/net/arp. ";
-        std::cerr << "Object IDs won't work." << std::endl;
-        return "";
-    }
-
-    char *res = fgets(buffer, 1024, arp);
-    if(res == NULL) {
-        std::cerr << "WARNING: Unexpected error reading /proc/net/arp. ";
-        std::cerr << "Object IDs won't work." << std::endl;
-        return "";
-    }
+    ospLock.lock();
+}
 
-    char *macaddr;
-    macaddr = strtok(buffer, " ");
-    macaddr = strtok(NULL, " ");
-    macaddr = strtok(NULL, " ");
-    macaddr = strtok(NULL, " ");
+OSPRayLock::~OSPRayLock()
+{
+    ospLock.unlock();
+}
 
-    // current time in milliseconds
-    unsigned long int ms = std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+unsigned long int createID()
+{
+    // IDs only need to be unique within this process, so a counter does
+    // the job without locks, syscalls or string building
+    // 0 is never handed out so it can mean "unset"
+    static std::atomic<unsigned long int> nextID(1);
+    return nextID.fetch_add(1, std::memory_order_relaxed);
+}
 
-    std::string ID(macaddr);
-    
-    return ID + ":" + std::to_string(ms);
+unsigned long int hashBytes(const void *data, unsigned long int size,
+        unsigned long int hash)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for(unsigned long int i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ul;
+    }
+    return hash;
 }
 
 }
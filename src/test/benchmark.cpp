@@ -1,6 +1,7 @@
 #include "pbnj.h"
 #include "Camera.h"
 #include "Configuration.h"
+#include "Image.h"
 #include "Renderer.h"
 #include "TransferFunction.h"
 #include "Volume.h"
@@ -9,10 +10,12 @@
 #include "rapidjson/document.h"
 
 #include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <random>
+#include <vector>
 
 void print_current_vals(int *imsize, float att, int samp)
 {
@@ -22,18 +25,105 @@ void print_current_vals(int *imsize, float att, int samp)
     std::cout << samp << "  ";
 }
 
+// time the omni image made from one 1x1 render per pixel, batched a
+// column at a time, against a single inward spherical render of the same
+// rays
+void benchmark_omni(pbnj::Volume *volume, pbnj::Renderer *renderer,
+        std::ofstream &csv)
+{
+    int omni_sizes[3][2] = {
+        { 90,  45},
+        {180,  90},
+        {360, 180}
+    };
+    std::vector<long unsigned int> bounds = volume->getBounds();
+    float radius = std::sqrt((float)(bounds[0]*bounds[0] +
+                bounds[1]*bounds[1] + bounds[2]*bounds[2]));
+    renderer->setVolume(volume);
+    csv << "width,height,per-pixel time (s),inward spherical time (s),";
+    csv << "speedup\n";
+
+    std::vector<pbnj::Image> images;
+    for(int size_index = 0; size_index < 3; size_index++) {
+        int width = omni_sizes[size_index][0];
+        int height = omni_sizes[size_index][1];
+        std::cout << std::setw(4) << width << " x ";
+        std::cout << std::setw(4) << height << "  ";
+
+        pbnj::Camera *pixel_camera = new pbnj::Camera(1, 1);
+        pixel_camera->setUpVector(0, 1, 0);
+        renderer->setCamera(pixel_camera);
+        std::vector<pbnj::CameraState> views(height);
+        auto begin = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < width; i++) {
+            for(int j = 0; j < height; j++) {
+                float phi = (M_PI * j / height) - M_PI / 2;
+                float theta = 2 * M_PI * i / width;
+                pixel_camera->setPosition(
+                        radius * std::sin(theta) * std::cos(phi),
+                        radius * std::sin(phi),
+                        radius * std::cos(theta) * std::cos(phi));
+                pixel_camera->centerView();
+                views[j] = pixel_camera->getState();
+            }
+            renderer->renderBatch(views, images);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        float per_pixel = std::chrono::duration_cast
+            <std::chrono::nanoseconds>(end - begin).count() / 1e9;
+        delete pixel_camera;
+
+        pbnj::Camera *camera = new pbnj::Camera(width, height);
+        camera->setProjection(pbnj::INWARD_SPHERICAL);
+        camera->setSphereRadius(radius);
+        camera->setView(0, 0, 1);
+        camera->setUpVector(0, 1, 0);
+        renderer->setCamera(camera);
+        pbnj::Image image;
+        begin = std::chrono::high_resolution_clock::now();
+        renderer->renderToImage(image);
+        end = std::chrono::high_resolution_clock::now();
+        float inward = std::chrono::duration_cast
+            <std::chrono::nanoseconds>(end - begin).count() / 1e9;
+        delete camera;
+
+        std::cout << std::setprecision(6) << per_pixel << " s  ";
+        std::cout << inward << " s  " << per_pixel / inward << "x";
+        std::cout << std::endl;
+        csv << width << "," << height << "," << per_pixel << ",";
+        csv << inward << "," << per_pixel / inward << "\n";
+    }
+}
+
 int main(int argc, const char **argv)
 {
     // we only need the config file for the dataset
     if(argc < 2 || argc > 3) {
-        std::cerr << "Usage: " << argv[0] << " <config_file.json> [png]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <config_file.json> [png|pngfast|qoi|batch|omni]" << std::endl;
         return 1;
     }
 
     std::string png_flag = "png";
+    std::string png_fast_flag = "pngfast";
+    std::string qoi_flag = "qoi";
+    std::string batch_flag = "batch";
+    std::string omni_flag = "omni";
     bool png_benchmark = false;
+    bool png_fast = false;
+    bool qoi = false;
+    bool batch = false;
     if(argc == 3 && png_flag == argv[2])
         png_benchmark = true;
+    if(argc == 3 && png_fast_flag == argv[2]) {
+        png_benchmark = true;
+        png_fast = true;
+    }
+    if(argc == 3 && qoi_flag == argv[2]) {
+        png_benchmark = true;
+        qoi = true;
+    }
+    if(argc == 3 && batch_flag == argv[2])
+        batch = true;
 
     // pbnj and volume initialization
     pbnj::ConfigReader *reader = new pbnj::ConfigReader();
@@ -44,6 +134,12 @@ int main(int argc, const char **argv)
     pbnj::Volume *volume = new pbnj::Volume(config->dataFilename,
             config->dataXDim, config->dataYDim, config->dataZDim);
 
+    if(argc == 3 && omni_flag == argv[2]) {
+        std::ofstream csv("benchmark_results_omni.csv");
+        benchmark_omni(volume, new pbnj::Renderer(), csv);
+        return 0;
+    }
+
     // benchmark parameters
     int image_sizes[6][2] = {
         {  64,   64},
@@ -68,13 +164,24 @@ int main(int argc, const char **argv)
         ramp.push_back(i/255.0);
     // open CSV file and write headers to it
     std::ofstream csv;
-    if(png_benchmark)
+    if(png_fast)
+        csv.open("benchmark_results_pngfast.csv");
+    else if(qoi)
+        csv.open("benchmark_results_qoi.csv");
+    else if(png_benchmark)
         csv.open("benchmark_results_png.csv");
+    else if(batch)
+        csv.open("benchmark_results_batch.csv");
     else
         csv.open("benchmark_results.csv");
     csv << "width,height,attenuation,samples per pixel,average time for ";
     csv << iterations << " iterations (s)\n";
     pbnj::Renderer *renderer = new pbnj::Renderer();
+    if(png_fast)
+        renderer->setPNGSettings(pbnj::PNGSettings::fast());
+
+    // reused by every batch of views
+    std::vector<pbnj::Image> images;
 
     // iterate over all benchmarking parameters
     for(int image_index = 0; image_index < 6; image_index++) {
@@ -96,8 +203,37 @@ int main(int argc, const char **argv)
 
                 unsigned long int duration = 0;
 
+                if(batch) {
+                    // render every random view as one batch, so only the
+                    // ray tracing is timed and not setting up the scene
+                    volume->attenuateOpacity(current_attenuation);
+                    pbnj::Camera *camera = new pbnj::Camera(
+                            current_image_size[0], current_image_size[1]);
+                    camera->setUpVector(0, 1, 0);
+                    std::vector<pbnj::CameraState> views;
+                    for(int iter_index = 0; iter_index < iterations; iter_index++) {
+                        camera->setPosition(cam_x(generator),
+                                cam_y(generator), cam_z(generator));
+                        camera->frameVolume(volume);
+                        views.push_back(camera->getState());
+                    }
+                    renderer->setVolume(volume);
+                    renderer->setCamera(camera);
+                    renderer->setSamples(current_samples);
+
+                    auto begin = std::chrono::high_resolution_clock::now();
+                    renderer->renderBatch(views, images);
+                    auto end = std::chrono::high_resolution_clock::now();
+                    duration = std::chrono::duration_cast
+                        <std::chrono::nanoseconds>(end - begin).count();
+
+                    volume->setOpacityMap(ramp);
+                    delete camera;
+                }
+
                 // time the total iterations and get an average
-                for(int iter_index = 0; iter_index < iterations; iter_index++) {
+                for(int iter_index = 0; !batch &&
+                        iter_index < iterations; iter_index++) {
                     // set current attenuation and reset after rendering
                     volume->attenuateOpacity(current_attenuation);
                     // setup a random camera
@@ -106,6 +242,9 @@ int main(int argc, const char **argv)
                     camera->setPosition(cam_x(generator), cam_y(generator),
                             cam_z(generator));
                     camera->setUpVector(0, 1, 0);
+                    // keep the random direction, but fill the image with
+                    // the volume so every run casts the same useful rays
+                    camera->frameVolume(volume);
 
                     // setup a renderer
                     renderer->setVolume(volume);
@@ -114,7 +253,10 @@ int main(int argc, const char **argv)
                     std::vector<unsigned char> png_data;
 
                     auto begin = std::chrono::high_resolution_clock::now();
-                    if(png_benchmark) {
+                    if(qoi) {
+                        renderer->renderToQOIObject(png_data); // throw away the buffer
+                    }
+                    else if(png_benchmark) {
                         renderer->renderToPNGObject(png_data); // throw away the buffer
                     }
                     else
@@ -127,7 +269,8 @@ int main(int argc, const char **argv)
                         std::string image_fname =
                             std::to_string(current_image_size[0]) + "_" +
                             std::to_string(current_attenuation) + "_" +
-                            std::to_string(current_samples) + ".png";
+                            std::to_string(current_samples) +
+                            (qoi ? ".qoi" : ".png");
                         lodepng::save_file(png_data, image_fname.c_str());
                     }
                     // reset opacity map
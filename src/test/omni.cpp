@@ -1,11 +1,13 @@
 #include "pbnj.h"
 #include "Camera.h"
 #include "Configuration.h"
+#include "Image.h"
 #include "Renderer.h"
 #include "TimeSeries.h"
 #include "TransferFunction.h"
 #include "Volume.h"
 
+#include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
@@ -17,9 +19,8 @@
 
 #define PI 3.14158
 
-void createOmni(pbnj::Volume *volume, pbnj::Renderer *renderer, 
-        pbnj::Camera *camera, pbnj::Configuration *config, std::string name, 
-        unsigned int renderWidth, unsigned int renderHeight)
+void omniSize(pbnj::Configuration *config, unsigned int renderWidth,
+        unsigned int &outputWidth, unsigned int &outputHeight)
 {
     float radius = (float) sqrt(config->dataXDim * config->dataXDim +
                                 config->dataYDim * config->dataYDim +
@@ -38,16 +39,52 @@ void createOmni(pbnj::Volume *volume, pbnj::Renderer *renderer,
     float angle_of_rotation = px_obj * 180 / PI; // in degrees
     std::cout<<"Angle of rotation is "<<angle_of_rotation<<std::endl;
 
-    unsigned int outputWidth = (unsigned int) 360/angle_of_rotation;
-    unsigned int outputHeight = (unsigned int) 180/angle_of_rotation;
+    outputWidth = (unsigned int) 360/angle_of_rotation;
+    outputHeight = (unsigned int) 180/angle_of_rotation;
+}
+
+void saveOmni(unsigned char *output, unsigned int outputWidth,
+        unsigned int outputHeight, std::string name,
+        std::string prefix = "omni_")
+{
+    std::vector<unsigned char> png;
+    unsigned int error = lodepng::encode(png, output, outputWidth, outputHeight);
+    if (error) 
+    {
+        std::cerr << "LodePNG had an error" << std::endl;
+        return;
+    }
+    lodepng::save_file(png, prefix + name + ".png");
+}
+
+// one 1x1 render per output pixel, from a camera on a sphere around the
+// volume looking in at its centre
+void createOmniPerPixel(pbnj::Volume *volume, pbnj::Renderer *renderer, 
+        pbnj::Configuration *config, std::string name, 
+        unsigned int renderWidth, unsigned int renderHeight)
+{
+    float radius = (float) sqrt(config->dataXDim * config->dataXDim +
+                                config->dataYDim * config->dataYDim +
+                                config->dataZDim * config->dataZDim);
+    unsigned int outputWidth, outputHeight;
+    omniSize(config, renderWidth, outputWidth, outputHeight);
     unsigned char *output = (unsigned char *) calloc(4*outputWidth*outputHeight, 1);
-    float currentPhi = -90, currentTheta = 0;
     float camx = 0, camy = radius, camz = 0;
 
     unsigned long int numPixels = outputWidth * outputHeight;
     std::cout << outputWidth << "x" << outputHeight << "=" << numPixels;
     std::cout << std::endl;
 
+    pbnj::Camera *camera = new pbnj::Camera(renderWidth, renderHeight);
+    camera->setUpVector(0, 1, 0);
+    renderer->setCamera(camera);
+
+    // a column of views is rendered as one batch, so the scene is only
+    // committed once per column instead of once per pixel
+    std::vector<pbnj::CameraState> views(outputHeight);
+    std::vector<pbnj::Image> images;
+    unsigned int centre = 4*(renderWidth/2);
+    auto begin = std::chrono::high_resolution_clock::now();
     for(int i = 0; i < outputWidth; i++) {
         std::cout << '\r' << /*std::setprecision(2) <<*/ std::setw(5);
         std::cout << 100 * (i/(float)outputWidth) << "%";
@@ -62,36 +99,82 @@ void createOmni(pbnj::Volume *volume, pbnj::Renderer *renderer,
             camz = radius*cos(currentTheta*PI/180)*cos(currentPhi*PI/180);
 
             camera->setPosition(camx, camy, camz);
-            renderer->setCamera(camera);
-
-            unsigned char *buffer;
-            renderer->renderToBuffer(&buffer);
+            camera->centerView();
+            views[j] = camera->getState();
+        }
+        renderer->renderBatch(views, images);
 
-            output[i*4 + j*outputWidth*4 + 0] = buffer[4*(renderWidth/2) + 4*renderWidth*(renderHeight/2) + 0];
-            output[i*4 + j*outputWidth*4 + 1] = buffer[4*(renderWidth/2) + 4*renderWidth*(renderHeight/2) + 1];
-            output[i*4 + j*outputWidth*4 + 2] = buffer[4*(renderWidth/2) + 4*renderWidth*(renderHeight/2) + 2];
+        for(int j = 0; j < outputHeight; j++) {
+            const unsigned char *pixel = images[j].getData() + centre +
+                images[j].getStride() * (renderHeight/2);
+            output[i*4 + j*outputWidth*4 + 0] = pixel[0];
+            output[i*4 + j*outputWidth*4 + 1] = pixel[1];
+            output[i*4 + j*outputWidth*4 + 2] = pixel[2];
             output[i*4 + j*outputWidth*4 + 3] = 255;
         }
     }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << std::endl;
+    std::cout << "Per-pixel render took " << std::chrono::duration_cast
+        <std::chrono::milliseconds>(end - begin).count() << " ms";
     std::cout << std::endl;
 
-    std::vector<unsigned char> png;
-    unsigned int error = lodepng::encode(png, output, outputWidth, outputHeight);
-    if (error) 
-    {
-        std::cerr << "LodePNG had an error" << std::endl;
-        return;
-    }
-    lodepng::save_file(png, "omni_" + name + ".png");
+    saveOmni(output, outputWidth, outputHeight, name, "omni_perpixel_");
+    free(output);
+    delete camera;
+}
+
+// the same rays from a single render with an inward spherical camera,
+// each starts on the sphere and goes through the volume's centre; pixels
+// are placed by ray direction rather than camera position, so each one
+// matches the per-pixel image's pixel for the opposite side of the sphere
+void createOmni(pbnj::Volume *volume, pbnj::Renderer *renderer, 
+        pbnj::Configuration *config, std::string name, 
+        unsigned int renderWidth)
+{
+    float radius = (float) sqrt(config->dataXDim * config->dataXDim +
+                                config->dataYDim * config->dataYDim +
+                                config->dataZDim * config->dataZDim);
+    unsigned int outputWidth, outputHeight;
+    omniSize(config, renderWidth, outputWidth, outputHeight);
+    std::cout << outputWidth << "x" << outputHeight << "=";
+    std::cout << outputWidth * outputHeight << std::endl;
+
+    // volumes are centred on the origin
+    pbnj::Camera *camera = new pbnj::Camera(outputWidth, outputHeight);
+    camera->setProjection(pbnj::INWARD_SPHERICAL);
+    camera->setSphereRadius(radius);
+    camera->setPosition(0, 0, 0);
+    camera->setView(0, 0, 1);
+    camera->setUpVector(0, 1, 0);
+    renderer->setCamera(camera);
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    unsigned char *output;
+    renderer->renderToBuffer(&output);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Inward spherical render took ";
+    std::cout << std::chrono::duration_cast<std::chrono::milliseconds>
+        (end - begin).count() << " ms";
+    std::cout << std::endl;
 
+    if(output != NULL)
+        saveOmni(output, outputWidth, outputHeight, name);
+    free(output);
+    delete camera;
 }
 
 int main(int argc, const char **argv)
 {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <config_file.json>" << std::endl;
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << " <config_file.json> [perpixel]" << std::endl;
         return 1;
     }
+    // perpixel makes the omni image the old way, one 1x1 render per pixel,
+    // to compare against the single inward spherical render
+    std::string perPixelFlag = "perpixel";
+    bool perPixel = argc == 3 && perPixelFlag == argv[2];
     unsigned int renderWidth = 1, renderHeight = 1;
 
     std::string confFile(argv[1]);
@@ -117,9 +200,6 @@ int main(int argc, const char **argv)
         timeSeries->setOpacityMap(config->opacityMap);
         timeSeries->setOpacityAttenuation(config->opacityAttenuation);
 
-        pbnj::Camera *camera = new pbnj::Camera(renderWidth, renderHeight);
-        camera->setUpVector(0, 1, 0);
-
         pbnj::Renderer *renderer = new pbnj::Renderer();
         renderer->setBackgroundColor(config->bgColor);
 
@@ -127,7 +207,13 @@ int main(int argc, const char **argv)
         {
             volume = timeSeries->getVolume(i);
             renderer->setVolume(volume);
-            createOmni(volume, renderer, camera, config, confName + std::to_string(i), renderWidth, renderHeight);
+            if(perPixel)
+                createOmniPerPixel(volume, renderer, config,
+                        confName + std::to_string(i), renderWidth,
+                        renderHeight);
+            else
+                createOmni(volume, renderer, config,
+                        confName + std::to_string(i), renderWidth);
         }
 
     }
@@ -140,14 +226,15 @@ int main(int argc, const char **argv)
         volume->setOpacityMap(config->opacityMap);
         volume->attenuateOpacity(config->opacityAttenuation);
 
-        pbnj::Camera *camera = new pbnj::Camera(renderWidth, renderHeight);
-        camera->setUpVector(0, 1, 0);
-
         pbnj::Renderer *renderer = new pbnj::Renderer();
         renderer->setBackgroundColor(config->bgColor);
         renderer->setVolume(volume);
 
-        createOmni(volume, renderer, camera, config, confName, renderWidth, renderHeight);
+        if(perPixel)
+            createOmniPerPixel(volume, renderer, config, confName,
+                    renderWidth, renderHeight);
+        else
+            createOmni(volume, renderer, config, confName, renderWidth);
     }
 
     return 0;
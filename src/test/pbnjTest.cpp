@@ -31,8 +31,7 @@ int main(int argc, const char **argv) {
 
     pbnj::Camera *camera = new pbnj::Camera(config->imageWidth, 
             config->imageHeight);
-    camera->setPosition((config->dataXDim-1)/2.0, (config->dataYDim-1)/2.0,
-            config->dataZDim*2);
+    camera->frameVolume(volume);
 
     pbnj::Renderer *renderer = new pbnj::Renderer();
     renderer->setVolume(volume);
@@ -50,7 +49,7 @@ int main(int argc, const char **argv) {
 
     pbnj::Volume *volume = new pbnj::Volume(filename, 256, 256, 256);
     pbnj::Camera *camera = new pbnj::Camera(800, 800);
-    camera->setPosition(127.5, 127.5, 512.0);
+    camera->frameVolume(volume);
     pbnj::Renderer *renderer = new pbnj::Renderer();
     renderer->setVolume(volume);
     renderer->setCamera(camera);
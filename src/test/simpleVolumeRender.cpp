@@ -73,6 +73,11 @@ int main(int argc, const char **argv)
                     config->dataXDim, config->dataYDim, config->dataZDim);
             timeSeries->setColorMap(config->colorMap);
             timeSeries->setOpacityMap(config->opacityMap);
+            timeSeries->setPercentileRange(config->lowPercentile,
+                    config->highPercentile);
+            timeSeries->setAutoOpacityMap(config->opacityMode);
+            timeSeries->setPreIntegration(config->preIntegration);
+            timeSeries->setSamplingRate(config->samplingRate);
             timeSeries->setOpacityAttenuation(config->opacityAttenuation);
             timeSeries->setMemoryMapping(true);
             single = false;
@@ -84,6 +89,11 @@ int main(int argc, const char **argv)
                     config->dataZDim);
             timeSeries->setColorMap(config->colorMap);
             timeSeries->setOpacityMap(config->opacityMap);
+            timeSeries->setPercentileRange(config->lowPercentile,
+                    config->highPercentile);
+            timeSeries->setAutoOpacityMap(config->opacityMode);
+            timeSeries->setPreIntegration(config->preIntegration);
+            timeSeries->setSamplingRate(config->samplingRate);
             timeSeries->setOpacityAttenuation(config->opacityAttenuation);
             timeSeries->setMemoryMapping(true);
             single = false;
@@ -102,6 +112,8 @@ int main(int argc, const char **argv)
     // rendering a single volume or a time series
     pbnj::Renderer *renderer = new pbnj::Renderer();
     renderer->setSamples(config->samples);
+    renderer->setTileSize(config->tileSize);
+    renderer->setPNGSettings(config->pngSettings);
     renderer->setBackgroundColor(config->bgColor);
     renderer->setCamera(camera);
 
@@ -112,7 +124,12 @@ int main(int argc, const char **argv)
         // set up any remaining config options for the volume
         volume->setColorMap(config->colorMap);
         volume->setOpacityMap(config->opacityMap);
+        volume->setPercentileRange(config->lowPercentile,
+                config->highPercentile);
+        volume->setAutoOpacityMap(config->opacityMode);
         volume->attenuateOpacity(config->opacityAttenuation);
+        volume->setPreIntegration(config->preIntegration);
+        volume->setSamplingRate(config->samplingRate);
 
         // set up the renderer and get an image
         if(config->isosurfaceValues.size() == 0) {
@@ -122,13 +139,19 @@ int main(int argc, const char **argv)
             renderer->setIsosurface(volume, config->isosurfaceValues,
                     config->specularity);
         }
-        renderer->renderImage(config->imageFilename);
+        if(config->posterBandHeight > 0)
+            renderer->renderPoster(config->imageFilename,
+                    config->posterBandHeight);
+        else
+            renderer->renderImage(config->imageFilename);
 
         std::cout << "Rendered image to " << config->imageFilename << std::endl;
     }
     else {
         // we have a series of volumes
-        // render an image of each one sequentially
+        // render an image of each one sequentially, each image is written
+        // to disk while the next volume renders
+        renderer->setWriteQueue(4);
         for(int v = 0; v < timeSeries->getLength(); v++) {
             // get the "current" volume
             volume = timeSeries->getVolume(v);
@@ -146,6 +169,8 @@ int main(int argc, const char **argv)
 
             std::cout << "Rendered image to " << imageFilename << std::endl;
         }
+        if(!renderer->flushImages())
+            std::cerr << "ERROR: not every image was written" << std::endl;
     }
 
     return 0;